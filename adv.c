@@ -1,13 +1,290 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include "src/adventure.h"
+#include "src/catalog.h"
+#include "src/server.h"
+#include "src/simulate.h"
+#include "src/endings.h"
+#include "src/paths.h"
+
+/*
+ * Parses the columns given to --width, or returns 0 when it isn't a
+ * number or is too narrow for the box.
+ */
+static uint16_t parse_width(char *s) {
+    char *end;
+    long const width = strtol(s, &end, 10);
+
+    if (end == s || *end != '\0' || width < MIN_WIDTH || width > UINT16_MAX) {
+        return 0;
+    }
+    return width;
+}
+
+/*
+ * adv serve [--socket path | --port n] [--width n] [--threads n] [--frame-cache mb] [--store file] [--log file] <file>
+ */
+static int serve(int argc, char **argv) {
+    char *filename = NULL;
+    ServeOptions options = (ServeOptions){
+        .socket = NULL,
+        .port = 0,
+        .width = HEADLESS_WIDTH,
+        .threads = 1,
+        .store = NULL,
+        .log = NULL,
+        .frame_cache = (size_t)SERVER_FRAME_CACHE_MB << 20,
+    };
+
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            options.socket = argv[++i];
+
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            options.port = atoi(argv[++i]);
+
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            options.width = parse_width(argv[++i]);
+            if (options.width == 0) {
+                printf("--width takes a number of columns, at least %d!\n", MIN_WIDTH);
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+
+        } else if (strcmp(argv[i], "--frame-cache") == 0 && i + 1 < argc) {
+            options.frame_cache = (size_t)atoi(argv[++i]) << 20;
+
+        } else if (strcmp(argv[i], "--store") == 0 && i + 1 < argc) {
+            options.store = argv[++i];
+
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            options.log = argv[++i];
+
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (filename == NULL) {
+        printf("No input file!\n");
+        return 1;
+    }
+
+    if (options.socket == NULL && options.port == 0) {
+        printf("Use --socket or --port to serve!\n");
+        return 1;
+    }
+
+    return serve_adventure(filename, options) ? 0 : 1;
+}
+
+/*
+ * adv simulate [--runs n] [--threads n] [--seed n] [--max-steps n] [--compact] <file>
+ */
+static int simulate_playthroughs(int argc, char **argv) {
+    char *filename = NULL;
+    SimulateOptions options = (SimulateOptions){
+        .runs = SIMULATE_DEFAULT_RUNS,
+        .threads = 0,
+        .seed = 1,
+        .max_steps = SIMULATE_DEFAULT_MAX_STEPS,
+        .compact = false,
+    };
+
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            options.runs = strtoull(argv[++i], NULL, 10);
+
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.seed = strtoull(argv[++i], NULL, 10);
+
+        } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            options.max_steps = strtoul(argv[++i], NULL, 10);
+
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            options.compact = true;
+
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (filename == NULL) {
+        printf("No input file!\n");
+        return 1;
+    }
+
+    return simulate_adventure(filename, options) ? 0 : 1;
+}
+
+/*
+ * adv paths [--first n] [--sample n] [--seed n] [--max-steps n] [--compact] <file>
+ */
+static int list_paths(int argc, char **argv) {
+    char *filename = NULL;
+    PathsOptions options = (PathsOptions){
+        .first = 0,
+        .sample = 0,
+        .seed = 1,
+        .max_steps = PATHS_DEFAULT_MAX_STEPS,
+        .compact = false,
+    };
+
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--first") == 0 && i + 1 < argc) {
+            options.first = strtoull(argv[++i], NULL, 10);
+
+        } else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            options.sample = strtoull(argv[++i], NULL, 10);
+
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.seed = strtoull(argv[++i], NULL, 10);
+
+        } else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) {
+            options.max_steps = strtoul(argv[++i], NULL, 10);
+
+        } else if (strcmp(argv[i], "--compact") == 0) {
+            options.compact = true;
+
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (filename == NULL) {
+        printf("No input file!\n");
+        return 1;
+    }
+
+    return print_paths(filename, options) ? 0 : 1;
+}
+
+/*
+ * adv log [--compact] <file> <log>
+ */
+static int show_log(int argc, char **argv) {
+    char *filenames[2] = {NULL, NULL};
+    bool compact = false;
+    int n = 0;
+
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--compact") == 0) {
+            compact = true;
+        } else if (n < 2) {
+            filenames[n++] = argv[i];
+        }
+    }
+
+    if (n < 2) {
+        printf("Usage: adv log [--compact] <file> <log>\n");
+        return 1;
+    }
+
+    Adventure adv;
+    if (!load_adventure_file(filenames[0], &adv)) {
+        return 1;
+    }
+
+    bool const ok = compact_choice_log(filenames[1], &adv, compact);
+    free_adventure(&adv);
+    return ok ? 0 : 1;
+}
 
 int main(int argc, char **argv) {
-    if (argc < 2) {
+    char *filename = NULL;
+    PlayOptions options = (PlayOptions){
+        .watch = false,
+        .shared = NULL,
+        .stats = false,
+        .compress = false,
+        .replay = NULL,
+        .headless = false,
+        .save = NULL,
+        .log = NULL,
+    };
+
+    if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+        return serve(argc, argv);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "simulate") == 0) {
+        return simulate_playthroughs(argc, argv);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "endings") == 0) {
+        bool const compact = argc > 2 && strcmp(argv[2], "--compact") == 0;
+        if (argc < 3 + compact) {
+            printf("No input file!\n");
+            return 1;
+        }
+        return print_ending_odds(argv[2 + compact], compact) ? 0 : 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "paths") == 0) {
+        return list_paths(argc, argv);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "log") == 0) {
+        return show_log(argc, argv);
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--watch") == 0) {
+            options.watch = true;
+
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.stats = true;
+
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            options.compress = true;
+
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            options.headless = true;
+
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            options.replay = argv[++i];
+
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            options.save = argv[++i];
+
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            options.log = argv[++i];
+
+        } else if (strcmp(argv[i], "--shared") == 0 && i + 1 < argc) {
+            options.shared = argv[++i];
+
+        } else if (strcmp(argv[i], "--unshare") == 0 && i + 1 < argc) {
+            catalog_remove(argv[++i]);
+            return 0;
+
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (filename == NULL) {
         printf("No input file!\n");
         return 1;
     }
 
-    play_adventure(*(argv + 1));
+    if (options.watch + (options.shared != NULL) + options.compress > 1) {
+        printf("Only one of --watch, --shared and --compress can be used!\n");
+        return 1;
+    }
+
+    if (options.watch && options.log != NULL) {
+        printf("Choices can't be logged with --watch!\n");
+        return 1;
+    }
+
+    play_adventure(filename, options);
     return 0;
 }
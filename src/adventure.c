@@ -2,171 +2,313 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <termios.h>
+#include <time.h>
 
 #include "utf8.h"
 #include "parse.h"
+#include "hint.h"
+#include "watch.h"
+#include "catalog.h"
+#include "compress.h"
+#include "render.h"
+#include "layout.h"
+#include "width.h"
+#include "input.h"
 #include "adventure.h"
-
-struct winsize w;
-int col = 0; // cursor position
-struct termios t;
-
-enum Delimiter {
-    WT_NEWLINE,
-    WT_BLANK,
-    WT_NONE,
+#include "save.h"
+
+static int resize_pipe[2] = {-1, -1}; // SIGWINCH wakes up the input loop through it
+static WatchedAdventure *watched = NULL; // set when playing with --watch
+static Input keys;                       // raw bytes from stdin (or the replay file)
+static bool headless = false;            // output goes nowhere
+
+enum WaitResult {
+    WAIT_KEY,
+    WAIT_TIMEOUT,
+    WAIT_RESIZE,
+    WAIT_RELOAD,
 };
 
-void show_error_message() {}
-
 /*
  * Prints the | at the beginning of the row.
  * To adjust the position, change L_O/L_I_PADDING values.
  */
-static void print_l_border() {
-    for (size_t i = 0; i < L_O_PADDING; ++i) printf(" ");
-    printf("|");
-    for (size_t i = 0; i < L_I_PADDING; ++i) printf(" ");
-    col = L_PADDING + 1;
+static void print_l_border(Renderer *r) {
+    frame_pad(r->out, ' ', L_O_PADDING);
+    frame_putc(r->out, '|');
+    frame_pad(r->out, ' ', L_I_PADDING);
+    r->col = L_PADDING + 1;
 }
 
 /*
  * Prints the | at the end of the row.
  * To adjust the position, change R_O/R_I_PADDING values.
  */
-static void complete_line(bool nl) {
-    size_t const max_col = w.ws_col - R_O_PADDING - 1;
-    for (int i = col; i < max_col; ++i) printf(" ");
-    printf("|");
-    if (nl) printf("\n");
+static void complete_line(Renderer *r, bool nl) {
+    size_t const max_col = r->width - R_O_PADDING - 1;
+    if (r->col < max_col) frame_pad(r->out, ' ', max_col - r->col);
+    frame_putc(r->out, '|');
+    if (nl) frame_putc(r->out, '\n');
 }
 
 /*
  * Prints a line with | at the beginning and the end of the row,
  * with whitespace in between.
  */
-static void print_empty_line() {
-    print_l_border();
-    complete_line(true);
+static void print_empty_line(Renderer *r) {
+    print_l_border(r);
+    complete_line(r, true);
 }
 
 /*
  * Prints a line with | at the beginning and the end of the row,
  * with - in between.
  */
-static void print_full_border() {
-    for (size_t i = 0; i < L_O_PADDING; ++i) printf(" ");
-    printf("+");
+static void print_full_border(Renderer *r) {
+    frame_pad(r->out, ' ', L_O_PADDING);
+    frame_putc(r->out, '+');
 
-    size_t const max_col = w.ws_col - R_O_PADDING - 1;
-    for (int i = L_I_PADDING + 1; i < max_col; ++i) printf("-");
-    printf("+\n");
+    size_t const max_col = r->width - R_O_PADDING - 1;
+    if (L_I_PADDING + 1 < max_col) frame_pad(r->out, '-', max_col - L_I_PADDING - 1);
+    frame_puts(r->out, "+\n");
 }
 
 /*
- * Extracts a word form a stream of characters.
- * Saves the word to a destination (dest) and sets the ammount
- * of characters to dest_len.
- * Also sets the size (in bytes) of the delimiter found (del_size).
+ * Copies a line that has whitespace other than plain spaces,
+ * showing every whitespace char as a space.
  */
-static enum Delimiter get_word(char *dest, size_t *dest_len, char *src, size_t *del_size) {
-    char pool[100] = {0};
-    *dest_len = 0;
+static void print_spaced(Renderer *r, char *text, Line *line) {
+    char *c = text + line->begin, *end = text + line->end;
 
-    while (true) {
-        size_t i = 1;
-        while (utf8nvalid(src, i) != 0) { ++i; }
-        utf8ncat(pool, src, i);
+    while (c < end) {
+        size_t const size = char_size(c);
 
-        if (*pool == 0) {
-            return WT_NONE;
+        if (char_is_blank(c)) {
+            frame_putc(r->out, ' ');
+        } else {
+            frame_put(r->out, c, size);
         }
+        c += size;
+    }
+}
 
-        if (isutf8whitespace(pool)) {
-            *del_size = i;
-            if (*pool == '\n') {
-                return WT_NEWLINE;
-            } else {
-                return WT_BLANK;
-            }
+/*
+ * Prints wrapped text inside the box.
+ */
+static void print_layout(Renderer *r, char *text, Layout *l) {
+    if (r->col == 0) {
+        print_l_border(r);
+    }
+
+    for (size_t i = 0; i < l->line_count; ++i) {
+        Line *line = &l->lines[i];
+
+        if (i > 0) {
+            complete_line(r, true);
+            print_l_border(r);
         }
 
-        utf8cat(dest, pool);
-        memset(pool, 0, 100);
-        (*dest_len)++;
-        src += i;
+        if (line->verbatim) {
+            frame_put(r->out, text + line->begin, line->end - line->begin);
+        } else {
+            print_spaced(r, text, line);
+        }
+        r->col += line->width;
     }
+
+    complete_line(r, false);
 }
 
 /*
  * Prints some text inside a box.
  * If possible, splits the paragraph to fit full words.
  */
-static void print_text(char *text) {
-    char word[100] = {0};
-    size_t word_len = 0, delimiter_size;
-    size_t const max_col = w.ws_col - R_PADDING - 1;
+static void print_text(Renderer *r, char *text) {
+    size_t const first_col = r->col == 0 ? (size_t)L_PADDING + 1 : r->col;
+    Layout l = layout_text(text, first_col, L_PADDING + 1, r->width - R_PADDING - 1);
 
-    if (col == 0) {
-        print_l_border();
-    }
+    print_layout(r, text, &l);
+    free_layout(&l);
+}
+
+/*
+ * SIGWINCH handler: wakes up wait_for_key through the self-pipe.
+ */
+static void on_resize(int sig) {
+    (void)sig;
+    int const saved_errno = errno;
 
-    enum Delimiter s = WT_BLANK;
-    while (*text && s != WT_NONE) {
-        s = get_word(word, &word_len, text, &delimiter_size);
+    write(resize_pipe[1], "", 1);
+    errno = saved_errno;
+}
 
-        if (col + word_len < max_col) {
-            printf("%s", word);
-            col += word_len;
-        } else {
-            complete_line(true);
-            print_l_border();
-            printf("%s", word);
-            col += word_len;
+/*
+ * Waits until a key is pressed, the terminal is resized
+ * or the watched file changes, for up to timeout ms (-1 for ever).
+ */
+static enum WaitResult wait_for_key(int timeout) {
+    struct pollfd fds[3] = {
+        { .fd = keys.fd, .events = POLLIN },
+        { .fd = resize_pipe[0], .events = POLLIN },
+        { .fd = watched != NULL ? watched->fd : -1, .events = POLLIN },
+    };
+
+    while (true) {
+        int const ready = poll(fds, 3, timeout);
+        if (ready < 0) {
+            continue; // interrupted by a signal
+        }
+        if (ready == 0) {
+            return WAIT_TIMEOUT;
         }
 
-        if (col + 1 < max_col) {
-            if (s == WT_NEWLINE) {
-                printf("\n");
-                print_l_border();
-            } else {
-                printf(" ");
-                col++;
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(resize_pipe[0], drain, sizeof(drain)) > 0);
+            return WAIT_RESIZE;
+        }
+
+        if (fds[2].revents & POLLIN) {
+            enum WatchResult r = watch_update(watched);
+            if (r == WATCH_PATCHED || r == WATCH_RELOADED) {
+                return WAIT_RELOAD;
             }
         }
 
-        text += strlen(word) + delimiter_size;
-        memset(word, 0, 100);
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            return WAIT_KEY;
+        }
     }
+}
 
-    complete_line(false);
+/*
+ * Takes the next key typed, reading more of stdin when there's
+ * none buffered. Returns early if something else happens in the meantime.
+ */
+static enum WaitResult next_key(Key *key) {
+    bool flush = false;
+
+    while (true) {
+        switch (input_key(&keys, key, flush)) {
+            case INPUT_KEY:
+                return WAIT_KEY;
+            case INPUT_EOF:
+                *key = (Key){ .type = KEY_CHAR, .cp = 'q' }; // stdin is gone, quit
+                return WAIT_KEY;
+            case INPUT_AGAIN:
+                break;
+        }
+
+        // a partial key is most likely an escape sequence on its way
+        enum WaitResult const r = wait_for_key(input_pending(&keys) ? INPUT_ESCAPE_TIMEOUT : -1);
+
+        if (r == WAIT_TIMEOUT) {
+            flush = true;
+        } else if (r == WAIT_KEY) {
+            input_fill(&keys);
+        } else {
+            return r;
+        }
+    }
 }
 
 /*
- * Gets (and shows) the input from the user.
+ * Sends the frame to the terminal, or drops it when headless.
  */
-static enum InputType get_input(Section *cs) {
-    fflush(stdin);
-    scanf("%c", &input);
+static void flush_output(Frame *frame) {
+    if (headless) {
+        frame_discard(frame);
+    } else {
+        frame_flush(frame, STDOUT_FILENO);
+    }
+}
+
+/*
+ * Columns of the terminal on stdout, never fewer than MIN_WIDTH.
+ * Falls back to HEADLESS_WIDTH when stdout isn't a terminal.
+ */
+static uint16_t terminal_width() {
+    struct winsize w = (struct winsize){};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != 0 || w.ws_col == 0) {
+        return HEADLESS_WIDTH;
+    }
+    return w.ws_col < MIN_WIDTH ? MIN_WIDTH : w.ws_col;
+}
+
+/*
+ * Ends the input line once an option has been chosen.
+ */
+static enum InputType select_option(Renderer *r) {
+    complete_line(r, true);
+    print_empty_line(r);
+    print_l_border(r);
+    return ADVENTURE_INPUT_OPTION;
+}
+
+/*
+ * Shows a key typed at the prompt and tells what it means.
+ * Option numbers can take several digits: the choice is made as soon
+ * as no more digits could follow, or when enter is pressed.
+ */
+static enum InputType read_key(Renderer *r, Section *cs, Key key) {
+    char input;
+
+    if (key.type == KEY_ENTER) {
+        input = '\n';
+    } else if (key.type == KEY_BACKSPACE) {
+        input = '\b';
+    } else if (key.type == KEY_CHAR && key.cp < 0x80) {
+        input = key.cp;
+    } else {
+        return ADVENTURE_INPUT_INVALID; // arrows, Esc and the like do nothing
+    }
 
     if (input == 'q' || input == 'Q') {
-        printf("%c", input);
-        col += 1;
-        complete_line(true);
-        print_full_border();
-        printf("\n");
+        frame_putc(r->out, input);
+        r->col += 1;
+        complete_line(r, true);
+        print_full_border(r);
+        frame_putc(r->out, '\n');
         return ADVENTURE_INPUT_QUIT;
 
-    } else if (input > '0' && input < cs->option_count + '1') {
-        printf("%c", input);
-        col += 1;
-        complete_line(true);
-        print_empty_line();
-        print_l_border();
-        return ADVENTURE_INPUT_OPTION;
+    } else if ((input == 'h' || input == 'H') && r->choice == 0) {
+        frame_putc(r->out, input);
+        r->col += 1;
+        complete_line(r, true);
+        return ADVENTURE_INPUT_HINT;
+
+    } else if (input >= '0' && input <= '9') {
+        size_t const next = r->choice * 10 + (input - '0');
+
+        if (next == 0 || next > cs->option_count) {
+            return ADVENTURE_INPUT_INVALID;
+        }
+
+        frame_putc(r->out, input);
+        r->col += 1;
+        r->choice = next;
+
+        if (r->choice * 10 > cs->option_count) {
+            return select_option(r);
+        }
+        return ADVENTURE_INPUT_PENDING;
+
+    } else if (input == '\n' && r->choice > 0) {
+        return select_option(r);
+
+    } else if (input == '\b' && r->choice > 0) {
+        frame_puts(r->out, "\b \b");
+        r->col -= 1;
+        r->choice /= 10;
+        return ADVENTURE_INPUT_PENDING;
 
     } else {
         return ADVENTURE_INPUT_INVALID;
@@ -174,53 +316,582 @@ static enum InputType get_input(Section *cs) {
 }
 
 /*
- * Displays current sections's text and options.
- * Asks for user input and advances to next section.
+ * Shows the precomputed hint for the current section,
+ * then asks for input again.
+ */
+static void print_hint(Renderer *r, Adventure *adv, Section *cs) {
+    char hint[100] = {0};
+    size_t option, distance;
+
+    if (adventure_hint(adv, cs, &option, &distance)) {
+        sprintf(hint, "Hint: option %zu gets you to an ending in %zu step(s).", option + 1, distance);
+    } else {
+        sprintf(hint, "Hint: no ending can be reached from here.");
+    }
+
+    print_l_border(r);
+    print_text(r, hint);
+    frame_putc(r->out, '\n');
+    print_l_border(r);
+    frame_puts(r->out, "> ");
+    r->col += 2;
+}
+
+/*
+ * Prints the session's current section and options, up to the prompt.
+ * Returns false for endings, which have nothing to ask.
+ */
+static bool show_section(Session *s) {
+    Renderer *r = &s->renderer;
+    Section *cs = &s->adv->sections[s->section];
+    SectionLayout *layout = layout_section(r->layouts, s->adv, cs, r->width);
+
+    print_layout(r, section_text(s->adv, cs), &layout->text);
+    frame_putc(r->out, '\n');
+
+    if (cs->option_count == 0) {
+        print_full_border(r);
+        return false;
+    }
+
+    print_l_border(r);
+    complete_line(r, false);
+
+    Option *options = section_options(cs);
+
+    for (size_t i = 0; i < cs->option_count; ++i) {
+        frame_putc(r->out, '\n');
+        print_l_border(r);
+        r->col += frame_printf(r->out, "%zu) ", i + 1);
+        print_layout(r, options[i].text, &layout->options[i]);
+    }
+    frame_putc(r->out, '\n');
+    print_l_border(r);
+    frame_puts(r->out, "> ");
+    r->col += 2;
+
+    if (r->choice > 0) {
+        // typed before a redraw
+        r->col += frame_printf(r->out, "%zu", r->choice);
+    }
+    return true;
+}
+
+/*
+ * show_section, through the session's frame cache if it has one: the
+ * section is only rendered when it isn't cached yet, and is left in
+ * s->frame instead of being printed. Frames showing a choice typed
+ * before a redraw aren't cached.
+ */
+static bool show_cached_section(Session *s) {
+    Renderer *r = &s->renderer;
+
+    if (s->frames == NULL || s->frame != NULL || r->choice > 0 || (r->col != 0 && r->col != (size_t)L_PADDING + 1)) {
+        return show_section(s);
+    }
+
+    enum FrameStyle const style = r->col == 0 ? FRAME_OPENS_ROW : FRAME_CONTINUES_ROW;
+    CachedFrame *f = frame_cache_get(s->frames, s->adv->content_hash, s->section, r->width, style);
+
+    if (f == NULL) {
+        Frame *out = r->out;
+        Frame rendered = (Frame){};
+
+        r->out = &rendered;
+        bool const asking = show_section(s);
+        r->out = out;
+
+        f = malloc(sizeof(CachedFrame) + rendered.len);
+        if (f == NULL) {
+            printf("Fatal error: can't malloc cached frame.");
+            exit(1);
+        }
+
+        *f = (CachedFrame){
+            .version = s->adv->content_hash,
+            .section = s->section,
+            .width = r->width,
+            .style = style,
+            .asking = asking,
+            .col = r->col,
+            .len = rendered.len,
+        };
+        memcpy(f->data, rendered.data, rendered.len);
+        free_frame(&rendered);
+
+        f = frame_cache_put(s->frames, f);
+    }
+
+    r->col = f->col;
+    s->frame = f;
+    return f->asking;
+}
+
+/*
+ * Hands the frame session_render left over to the caller, who writes
+ * it after the rest and then gives it back with frame_cache_release.
+ */
+CachedFrame *session_take_frame(Session *s) {
+    CachedFrame *f = s->frame;
+    s->frame = NULL;
+    return f;
+}
+
+/*
+ * Starts a session at adv's first section. Its text is wrapped
+ * through layouts, which sessions on the same thread can share.
+ */
+void session_init(Session *s, Adventure *adv, LayoutCache *layouts, uint16_t width) {
+    *s = (Session){
+        .adv = adv,
+        .section = 0,
+        .state = SESSION_START,
+        .renderer = (Renderer){ .layouts = layouts, .width = width },
+    };
+}
+
+/*
+ * Appends whatever the session has to show to out: the keys typed,
+ * hints, and the current section when it changed. Sessions with a frame
+ * cache leave the section in s->frame; take it before rendering again.
+ * Returns false once the session is over.
+ */
+bool session_render(Session *s, Frame *out) {
+    Renderer *r = &s->renderer;
+
+    if (s->pending.len > 0) {
+        frame_put(out, s->pending.data, s->pending.len);
+    }
+    free_frame(&s->pending);
+    r->out = out;
+
+    switch (s->state) {
+        case SESSION_START:
+            print_full_border(r);
+            s->state = show_cached_section(s) ? SESSION_ASKING : SESSION_OVER;
+            break;
+
+        case SESSION_RESIZED:
+            // everything on screen was wrapped for the old width:
+            // clear it and show the current section again
+            frame_puts(out, "\x1b[H\x1b[2J");
+            r->col = 0;
+            print_full_border(r);
+            s->state = show_cached_section(s) ? SESSION_ASKING : SESSION_OVER;
+            break;
+
+        case SESSION_RELOADED:
+        case SESSION_RESUMED:
+            // the section was kept by id, or is the stored one: show it
+            r->choice = 0;
+            complete_line(r, true);
+            print_l_border(r);
+            print_text(r, s->state == SESSION_RELOADED ? "The adventure was updated." : "Welcome back!");
+            frame_putc(out, '\n');
+            print_empty_line(r);
+            print_l_border(r);
+            s->state = show_cached_section(s) ? SESSION_ASKING : SESSION_OVER;
+            break;
+
+        case SESSION_MOVED:
+            s->state = show_cached_section(s) ? SESSION_ASKING : SESSION_OVER;
+            break;
+
+        case SESSION_ASKING:
+        case SESSION_OVER:
+            break;
+    }
+
+    r->out = NULL;
+    return s->state != SESSION_OVER;
+}
+
+/*
+ * Remembers an option the session took, so it can be saved. Once it
+ * remembers SESSION_HISTORY of them, it forgets the older half and
+ * moves origin to where they led.
+ */
+static void record_option(Session *s, uint8_t option) {
+    if (s->history_len == SESSION_HISTORY) {
+        uint32_t const forget = SESSION_HISTORY / 2;
+
+        for (uint32_t i = 0; i < forget; ++i) {
+            Section *cs = &s->adv->sections[s->origin];
+            s->origin = find_section(s->adv, section_options(cs)[s->history[i]].section_id) - s->adv->sections;
+        }
+        s->history_len -= forget;
+        memmove(s->history, s->history + forget, s->history_len);
+    }
+
+    if (s->history_len == s->history_capacity) {
+        s->history_capacity = s->history_capacity ? s->history_capacity * 2 : 16;
+        uint8_t *p = realloc(s->history, s->history_capacity);
+
+        if (p == NULL) {
+            printf("Fatal error: can't realloc session history.");
+            exit(1);
+        }
+        s->history = p;
+    }
+
+    s->history[s->history_len++] = option;
+}
+
+/*
+ * Acts on a key typed by the session's player: shows it, shows hints
+ * and moves on to the chosen section. What it prints waits in the
+ * session until session_render is called.
  */
-static bool play_section(Adventure *adv) {
-    print_text(adv->current_section->text);
-    printf("\n");
+enum Transition session_feed(Session *s, Key key) {
+    Renderer *r = &s->renderer;
+    Adventure *adv = s->adv;
+    Section *cs = &adv->sections[s->section];
+
+    if (s->state != SESSION_ASKING) {
+        return TRANSITION_NONE;
+    }
+
+    r->out = &s->pending;
+    enum InputType const input_type = read_key(r, cs, key);
 
-    if (adv->current_section->option_count == 0) {
-        print_full_border();
-        return true;
+    if (input_type == ADVENTURE_INPUT_HINT) {
+        print_hint(r, adv, cs);
     }
+    r->out = NULL;
+
+    switch (input_type) {
+        case ADVENTURE_INPUT_QUIT:
+            s->state = SESSION_OVER;
+            return TRANSITION_QUIT;
+
+        case ADVENTURE_INPUT_OPTION: {
+            size_t const option = r->choice - 1;
+            Section *next = find_section(adv, section_options(cs)[option].section_id);
+            r->choice = 0;
 
-    print_l_border();
-    complete_line(false);
+            if (next == NULL) {
+                s->state = SESSION_MOVED; // dangling option, show the section again
+                return TRANSITION_NONE;
+            }
+
+            record_option(s, option);
+            if (s->log != NULL) {
+                choice_log_append(s->log, s->id, s->section, next - adv->sections, option);
+            }
+            s->section = next - adv->sections;
+            s->state = SESSION_MOVED;
+            return next->option_count == 0 ? TRANSITION_ENDED : TRANSITION_MOVED;
+        }
 
-    for (size_t i = 0; i < adv->current_section->option_count; ++i) {
-        printf("\n");
-        print_l_border();
-        printf("%zu) ", i + 1);
-        col += 3;
-        print_text(adv->current_section->options[i].text);
+        case ADVENTURE_INPUT_HINT:
+            return TRANSITION_HINT;
+        case ADVENTURE_INPUT_PENDING:
+            return TRANSITION_PENDING;
+        default:
+            return TRANSITION_NONE;
     }
-    printf("\n");
-    print_l_border();
-    printf("> ");
-    col += 2;
+}
 
-    enum InputType input_type;
-    do {
-        input_type = get_input(adv->current_section);
-    } while (input_type == ADVENTURE_INPUT_INVALID);
+/*
+ * The session's screen changed size: it's shown again from scratch.
+ */
+void session_resize(Session *s, uint16_t width) {
+    s->renderer.width = width;
+    if (s->state == SESSION_ASKING) {
+        s->state = SESSION_RESIZED;
+    }
+}
 
-    if (input_type == ADVENTURE_INPUT_QUIT) {
-        return true;
+/*
+ * The adventure was reloaded, keeping adv->current_section by id:
+ * the session goes on from there. Options taken before don't mean
+ * the same in the new version, so the history starts over there too.
+ */
+void session_reload(Session *s) {
+    s->section = s->adv->current_section - s->adv->sections;
+    s->origin = s->section;
+    s->history_len = 0;
+    if (s->state == SESSION_ASKING) {
+        s->state = SESSION_RELOADED;
     }
+}
 
-    input -= 49;
-    size_t next_id = adv->current_section->options[input].section_id;
+/*
+ * The session's section and history were replaced (see store.h):
+ * it goes on from there.
+ */
+void session_resumed(Session *s) {
+    if (s->state == SESSION_ASKING) {
+        s->state = SESSION_RESUMED;
+    }
+}
+
+void free_session(Session *s) {
+    if (s->frame != NULL) {
+        frame_cache_release(s->frames, s->frame);
+        s->frame = NULL;
+    }
+    free_frame(&s->pending);
+    free(s->history);
+    s->history = NULL;
+    s->history_len = s->history_capacity = 0;
+}
+
+/*
+ * Prints stats about the played adventure to stderr.
+ */
+static void print_stats(Adventure *adv, LayoutCache *layouts, Frame *frame) {
+    if (adv->strings != NULL) {
+        fprintf(
+            stderr, "text: %zu strings, %zu unique, %zu bytes kept, %zu bytes saved by sharing\n",
+            adv->strings->strings, adv->strings->unique, adv->strings->bytes, adv->strings->saved_bytes
+        );
+    }
+
+    if (adv->codec != NULL) {
+        fprintf(
+            stderr, "section text: %zu bytes plain, %zu bytes compressed\n",
+            adv->codec->plain_bytes, adv->codec->compressed_bytes
+        );
+    }
+
+    if (layouts->hits + layouts->misses > 0) {
+        fprintf(
+            stderr, "layout: %zu hits, %zu misses\n",
+            layouts->hits, layouts->misses
+        );
+    }
+
+    if (frame->frames > 0) {
+        fprintf(
+            stderr, "output: %zu frames, %.2f writes and %.1f bytes per frame\n",
+            frame->frames, (double)frame->writes / frame->frames, (double)frame->bytes / frame->frames
+        );
+    }
+}
+
+/*
+ * Whether two loads of an adventure have the same content.
+ */
+static bool same_content(Adventure *a, Adventure *b) {
+    return a->content_hash == b->content_hash && strcmp(a->title, b->title) == 0 &&
+        strcmp(a->author, b->author) == 0 && strcmp(a->version, b->version) == 0;
+}
+
+/*
+ * Maps the adventure from shared memory.
+ * The first process to get here parses the file and publishes it.
+ * A segment whose publisher died halfway, or that holds an older
+ * version of the file, is replaced. If it can't be shared the
+ * adventure is loaded into adv instead, and c->base is left NULL.
+ * Returns the adventure to play, NULL if the file can't be loaded.
+ */
+static Adventure *load_shared(char *filename, char *name, Catalog *c, Adventure *adv) {
+    struct stat source;
+    bool const found = stat(filename, &source) == 0;
+
+    bool opened = found && catalog_open(name, c);
+    if (opened && catalog_from(c, &source)) {
+        return &c->adv;
+    }
+
+    if (!load_adventure_file(filename, adv)) {
+        if (opened) catalog_close(c);
+        return NULL;
+    }
+
+    enum CatalogResult r = CATALOG_EXISTS;
+    if (!opened) {
+        r = catalog_publish(name, adv, &source);
+        opened = r != CATALOG_ERROR && catalog_open(name, c);
+    }
 
-    for (size_t i = 0; i < adv->section_count; ++i) {
-        if (adv->sections[i].id == next_id) {
-            adv->current_section = &adv->sections[i];
+    // the file was only touched, or someone else just published it
+    if (opened && same_content(&c->adv, adv)) {
+        if (!catalog_from(c, &source)) {
+            catalog_update_source(name, c, &source);
+        }
+        free_adventure(adv);
+        return &c->adv;
+    }
+
+    // what's there is stale: an older version, or its publisher died
+    if (r != CATALOG_ERROR) {
+        if (opened) catalog_close(c);
+        catalog_remove(name);
+
+        // another process may have replaced it first
+        if (catalog_publish(name, adv, &source) != CATALOG_ERROR && catalog_open(name, c)) {
+            free_adventure(adv);
+            return &c->adv;
+        }
+    }
+
+    c->base = NULL;
+    return adv;
+}
+
+/*
+ * Starts a session from the first section, logged to log as a new
+ * session unless log is NULL.
+ */
+static void start_session(Session *s, Adventure *adv, LayoutCache *layouts, uint16_t width, ChoiceLog *log) {
+    session_init(s, adv, layouts, width);
+    s->log = log;
+    if (log != NULL) {
+        s->id = choice_log_session(log);
+    }
+}
+
+/*
+ * Plays until quitting, printing to frame. Headless replays go on
+ * from the first section whenever they reach an ending, until the keys
+ * run out. With a save file, the game resumes from it and it's kept
+ * up to date on every move; reaching an ending removes it.
+ * Choices are logged to log, unless it's NULL.
+ * Returns how many options were taken.
+ */
+static size_t play(Adventure *adv, LayoutCache *layouts, Frame *frame, uint16_t width, char *save, ChoiceLog *log) {
+    Session s;
+    enum Transition last = TRANSITION_NONE;
+    size_t transitions = 0;
+    start_session(&s, adv, layouts, width, log);
+
+    if (save != NULL && access(save, F_OK) == 0) {
+        enum SaveResult const r = restore_session_file(&s, save);
+
+        if (r != SAVE_OK) {
+            printf("%s\n", save_result_message(r));
+            free_session(&s);
+            return 0;
+        }
+    }
+
+    while (true) {
+        while (session_render(&s, frame)) { // main loop
+            flush_output(frame);
+
+            // a reload keeps current_section by id
+            adv->current_section = &adv->sections[s.section];
+
+            Key key;
+            switch (next_key(&key)) {
+                case WAIT_RESIZE:
+                    layout_cache_clear(layouts);
+                    session_resize(&s, terminal_width());
+                    break;
+
+                case WAIT_RELOAD:
+                    free_layout_cache(layouts);
+                    layout_cache_init(layouts, adv->section_count);
+                    session_reload(&s);
+
+                    if (save != NULL) {
+                        save_session_file(&s, save);
+                    }
+                    break;
+
+                default:
+                    last = session_feed(&s, key);
+                    transitions += last == TRANSITION_MOVED || last == TRANSITION_ENDED;
+
+                    if (save != NULL && last == TRANSITION_MOVED) {
+                        save_session_file(&s, save);
+                    } else if (save != NULL && last == TRANSITION_ENDED) {
+                        unlink(save);
+                    }
+                    break;
+            }
+        }
+
+        if (!headless || last != TRANSITION_ENDED || adv->sections->option_count == 0) {
             break;
         }
+
+        free_session(&s);
+        start_session(&s, adv, layouts, width, log);
+        last = TRANSITION_NONE;
+    }
+
+    free_session(&s);
+    return transitions;
+}
+
+/*
+ * Opens the keys to play with: the replay file, or stdin.
+ */
+static bool open_keys(PlayOptions options) {
+    int fd = STDIN_FILENO;
+
+    if (options.replay != NULL) {
+        fd = open(options.replay, O_RDONLY);
+
+        if (fd < 0) {
+            printf("Replay file not found!\n");
+            return false;
+        }
+
+    } else if (options.headless && isatty(STDIN_FILENO)) {
+        printf("Nothing to replay: use --replay or pipe the keys in!\n");
+        return false;
+    }
+
+    input_init(&keys, fd);
+    return true;
+}
+
+/*
+ * Sets the terminal up, plays and reports.
+ */
+static void run(Adventure *playing, PlayOptions options, ChoiceLog *log) {
+    Frame frame = (Frame){};
+    LayoutCache layouts;
+    uint16_t width = HEADLESS_WIDTH;
+
+    headless = options.headless;
+    if (!headless) {
+        struct termios t;
+        tcgetattr(0, &t);
+        t.c_lflag &= ~(ECHO|ICANON);
+        tcsetattr(0, TCSANOW, &t);
+
+        width = terminal_width();
+    }
+
+    if (pipe(resize_pipe) == 0) {
+        fcntl(resize_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(resize_pipe[1], F_SETFL, O_NONBLOCK);
+    }
+    signal(SIGWINCH, on_resize);
+    layout_cache_init(&layouts, playing->section_count);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t const transitions = play(playing, &layouts, &frame, width, options.save, log);
+    flush_output(&frame);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (headless || options.replay != NULL) {
+        double const seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        fprintf(
+            stderr, "replay: %zu transitions in %.3f s, %.0f transitions/s\n",
+            transitions, seconds, seconds > 0 ? transitions / seconds : 0
+        );
+    }
+
+    if (options.stats) {
+        print_stats(playing, &layouts, &frame);
+    }
+
+    signal(SIGWINCH, SIG_DFL);
+    close(resize_pipe[0]);
+    close(resize_pipe[1]);
+    if (keys.fd != STDIN_FILENO) {
+        close(keys.fd);
     }
 
-    return false;
+    free_layout_cache(&layouts);
+    free_frame(&frame);
 }
 
 /*
@@ -228,29 +899,64 @@ static bool play_section(Adventure *adv) {
  * Loads and plays the adventure.
  * If necessary, displays error.
  */
-void play_adventure(char *filename) {
-    FILE *f = fopen(filename, "r");
+void play_adventure(char *filename, PlayOptions options) {
+    WatchedAdventure wa;
+    Catalog catalog;
+    Adventure adv;
+    Adventure *playing = &adv;
+
+    if (options.watch) {
+        if (access(filename, R_OK) != 0) {
+            printf("File not found!\n");
+            return;
+        }
 
-    if (f == NULL) {
-        printf("File not found!\n");
+        if (!watch_adventure(&wa, filename)) {
+            show_parse_error();
+            return;
+        }
+
+        watched = &wa;
+        playing = &wa.adv;
+
+    } else if (options.shared != NULL) {
+        playing = load_shared(filename, options.shared, &catalog, &adv);
+        if (playing == NULL) {
+            return;
+        }
+
+    } else if (!load_adventure_file(filename, &adv)) {
         return;
+
+    } else if (options.compress) {
+        compress_adventure(&adv);
     }
 
-    Adventure adv = json_to_adventure(json_parse(f));
-    fclose(f);
+    ChoiceLog log;
+    enum ChoiceLogResult logged = CHOICE_LOG_OK;
 
-    if (parse_state != PS_OK) {
-        show_error_message();
-        return;
+    if (options.log != NULL) {
+        logged = choice_log_open(&log, options.log, playing);
+
+        if (logged != CHOICE_LOG_OK) {
+            printf(logged == CHOICE_LOG_OTHER_ADVENTURE ? "The choice log is for another adventure!\n" : "Can't open the choice log!\n");
+        }
     }
 
-    tcgetattr(0, &t);
-    t.c_lflag &= ~(ECHO|ICANON);
-    tcsetattr(0, TCSANOW, &t);
+    if (logged == CHOICE_LOG_OK && open_keys(options)) {
+        run(playing, options, options.log != NULL ? &log : NULL);
+    }
 
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w); // get terminal size
+    if (options.log != NULL && logged == CHOICE_LOG_OK) {
+        choice_log_close(&log);
+    }
 
-    adv.current_section = adv.sections;   // start at first section
-    print_full_border();
-    while (!play_section(&adv));          // main loop
+    if (watched != NULL) {
+        unwatch_adventure(watched);
+        watched = NULL;
+    } else if (options.shared != NULL && catalog.base != NULL) {
+        catalog_close(&catalog);
+    } else {
+        free_adventure(&adv);
+    }
 }
@@ -1,24 +1,117 @@
 #ifndef TEXT_ADVENTURES_ADVENTURE
 #define TEXT_ADVENTURES_ADVENTURE
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parse.h"
+#include "render.h"
+#include "input.h"
+#include "layout.h"
+#include "choicelog.h"
+#include "framecache.h"
+
 enum InputType {
     ADVENTURE_INPUT_OPTION,
     ADVENTURE_INPUT_QUIT,
+    ADVENTURE_INPUT_HINT,
+    ADVENTURE_INPUT_PENDING,
+    ADVENTURE_INPUT_RELOAD,
+    ADVENTURE_INPUT_RESIZE,
     ADVENTURE_INPUT_INVALID,
 };
 
-char input;
-
 #define L_O_PADDING 1
 #define R_O_PADDING 1
 #define L_I_PADDING 1
 #define R_I_PADDING 1
 
+#define HEADLESS_WIDTH 80 // columns rendered to when there's no terminal
+#define MIN_WIDTH 20      // narrowest box a session is rendered in
+#define SESSION_HISTORY 4096 // options a session remembers taking
+
 static const int O_PADDING = L_O_PADDING + R_O_PADDING;
 static const int I_PADDING = L_I_PADDING + R_I_PADDING;
 static const int L_PADDING = L_O_PADDING + L_I_PADDING;
 static const int R_PADDING = R_O_PADDING + R_I_PADDING;
 
-void play_adventure(char *filename);
+typedef struct PlayOptions {
+    bool watch;    // reload the file when it changes
+    char *shared;  // shared memory segment to map the adventure from
+    bool stats;    // print memory/render stats on exit
+    bool compress; // keep section text compressed
+    char *replay;  // file to read the keys from instead of stdin
+    bool headless; // no terminal: render to a buffer, restart at endings
+    char *save;    // file the game is resumed from and saved to
+    char *log;     // file every choice is logged to
+} PlayOptions;
+
+/*
+ * Where and how a session is printed.
+ */
+typedef struct Renderer {
+    Frame *out;           // output goes here while rendering
+    LayoutCache *layouts; // wrapped text, shared by the sessions of a thread
+    size_t col;           // cursor position
+    uint32_t choice;      // option number typed so far
+    uint16_t width;       // columns
+} Renderer;
+
+enum SessionState {
+    SESSION_START,      // nothing was shown yet
+    SESSION_MOVED,      // the new section has to be shown
+    SESSION_RESIZED,    // everything has to be shown again
+    SESSION_RELOADED,   // the adventure changed under the session
+    SESSION_RESUMED,    // the session was swapped for a stored one
+    SESSION_ASKING,     // waiting for keys
+    SESSION_OVER,
+};
+
+enum Transition {
+    TRANSITION_NONE,    // the key means nothing here
+    TRANSITION_PENDING, // a digit that may be followed by more
+    TRANSITION_HINT,
+    TRANSITION_MOVED,   // went on to another section
+    TRANSITION_ENDED,   // went on to an ending
+    TRANSITION_QUIT,
+};
+
+/*
+ * One player going through an adventure. Sessions don't block:
+ * whoever runs them feeds them keys and renders them when it suits it.
+ */
+typedef struct Session {
+    Adventure *adv;
+    uint32_t section; // index of the current section
+    enum SessionState state;
+    Renderer renderer;
+    Frame pending;    // printed by session_feed, waiting for session_render
+
+    // options taken since section origin, one byte each (see save.h)
+    uint32_t origin;
+    uint32_t history_len, history_capacity;
+    uint8_t *history;
+
+    // where the session's choices are logged, if anywhere
+    ChoiceLog *log;
+    uint32_t id;
+
+    // with a frame cache, session_render leaves the section it shows
+    // in frame, to be written after its output (see session_take_frame)
+    FrameCache *frames;
+    CachedFrame *frame;
+} Session;
+
+void play_adventure(char *filename, PlayOptions options);
+
+void session_init(Session *s, Adventure *adv, LayoutCache *layouts, uint16_t width);
+bool session_render(Session *s, Frame *out);
+enum Transition session_feed(Session *s, Key key);
+void session_resize(Session *s, uint16_t width);
+void session_reload(Session *s);
+void session_resumed(Session *s);
+CachedFrame *session_take_frame(Session *s);
+void free_session(Session *s);
 
 #endif // TEXT_ADVENTURES_ADVENTURE
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "parse.h"
+#include "compress.h"
+#include "catalog.h"
+
+#define CATALOG_MAGIC "ADVCAT3"
+#define CATALOG_WAIT_MS 5000 // how long to wait for another publisher
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+/*
+ * shm_open wants names that start with /.
+ */
+static char *segment_name(char *name, char *buffer, size_t size) {
+    snprintf(buffer, size, "%s%s", *name == '/' ? "" : "/", name);
+    return buffer;
+}
+
+/*
+ * Copies a string into the segment, returns its offset.
+ */
+static uint64_t put_string(char *base, size_t *cursor, char *s) {
+    size_t const len = strlen(s) + 1;
+    uint64_t const at = *cursor;
+
+    memcpy(base + at, s, len);
+    *cursor += len;
+    return at;
+}
+
+static int64_t mtime_ns(struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+/*
+ * Writes an adventure to a new shared memory segment, noting the file
+ * it came from (source, if any). If the segment already exists it's
+ * left alone.
+ */
+enum CatalogResult catalog_publish(char *name, Adventure *adv, struct stat *source) {
+    char shm_name[256];
+    segment_name(name, shm_name, sizeof(shm_name));
+
+    size_t option_count = 0, string_size = 0;
+    string_size += strlen(adv->title) + strlen(adv->author) + strlen(adv->version) + 3;
+
+    for (size_t i = 0; i < adv->section_count; ++i) {
+        Section *s = &adv->sections[i];
+        Option *options = section_options(s);
+
+        string_size += strlen(section_text(adv, s)) + 1;
+        option_count += s->option_count;
+        for (size_t j = 0; j < s->option_count; ++j) {
+            string_size += strlen(options[j].text) + 1;
+        }
+    }
+
+    size_t const n = adv->section_count;
+    CatalogHeader h = (CatalogHeader){
+        .section_count = n,
+        .publisher = getpid(),
+        .id_index_size = adv->id_index_size,
+        .content_hash = adv->content_hash,
+        .source_inode = source != NULL ? source->st_ino : 0,
+        .source_size = source != NULL ? source->st_size : 0,
+        .source_mtime = source != NULL ? mtime_ns(source) : 0,
+    };
+
+    size_t size = align8(sizeof(CatalogHeader));
+    h.sections = size;        size += align8(sizeof(CatalogSection) * n);
+    h.options = size;         size += align8(sizeof(CatalogOption) * option_count);
+    h.id_index = size;        size += align8(sizeof(uint32_t) * adv->id_index_size);
+    h.ending_distance = size; size += align8(sizeof(uint32_t) * n);
+    h.hint_option = size;     size += align8(sizeof(uint8_t) * n);
+    size_t cursor = size;     size += string_size;
+    h.size = size;
+
+    int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return errno == EEXIST ? CATALOG_EXISTS : CATALOG_ERROR;
+    }
+
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        shm_unlink(shm_name);
+        return CATALOG_ERROR;
+    }
+
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(shm_name);
+        return CATALOG_ERROR;
+    }
+    ((CatalogHeader *)base)->publisher = h.publisher;
+
+    h.title = put_string(base, &cursor, adv->title);
+    h.author = put_string(base, &cursor, adv->author);
+    h.version = put_string(base, &cursor, adv->version);
+
+    CatalogSection *sections = (CatalogSection *)(base + h.sections);
+    CatalogOption *options = (CatalogOption *)(base + h.options);
+    size_t next_option = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        Section *s = &adv->sections[i];
+        Option *o = section_options(s);
+
+        sections[i] = (CatalogSection){
+            .text = put_string(base, &cursor, section_text(adv, s)),
+            .id = s->id,
+            .option_count = s->option_count,
+            .first_option = next_option,
+        };
+
+        for (size_t j = 0; j < s->option_count; ++j) {
+            options[next_option++] = (CatalogOption){
+                .text = put_string(base, &cursor, o[j].text),
+                .section_id = o[j].section_id,
+            };
+        }
+    }
+
+    memcpy(base + h.id_index, adv->id_index, sizeof(uint32_t) * adv->id_index_size);
+    memcpy(base + h.ending_distance, adv->ending_distance, sizeof(uint32_t) * n);
+    memcpy(base + h.hint_option, adv->hint_option, sizeof(uint8_t) * n);
+
+    CatalogHeader *header = (CatalogHeader *)base;
+    memcpy(header, &h, sizeof(CatalogHeader));
+    memcpy(header->magic, CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+    atomic_store(&header->ready, 1);
+
+    munmap(base, size);
+    return CATALOG_OK;
+}
+
+/*
+ * Waits for the publisher of a segment to finish writing it.
+ * Gives up early if the publisher died.
+ */
+static bool wait_until_ready(int fd, CatalogHeader **header, size_t *size) {
+    struct timespec const nap = { .tv_sec = 0, .tv_nsec = 1000000 };
+    struct stat st;
+
+    for (int waited = 0; waited < CATALOG_WAIT_MS; ++waited) {
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(CatalogHeader)) {
+            *size = st.st_size;
+            *header = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+            if (*header == MAP_FAILED) return false;
+
+            if (atomic_load(&(*header)->ready)) return true;
+            pid_t const publisher = (*header)->publisher;
+            munmap(*header, *size);
+
+            if (publisher > 0 && kill(publisher, 0) != 0 && errno == ESRCH) {
+                return false;
+            }
+        }
+        nanosleep(&nap, NULL);
+    }
+
+    return false;
+}
+
+/*
+ * Maps a published adventure read-only.
+ * Only the Section array (and spilled options) is private to this
+ * process; text, the id index and hint tables are shared.
+ */
+bool catalog_open(char *name, Catalog *c) {
+    char shm_name[256];
+    segment_name(name, shm_name, sizeof(shm_name));
+
+    int fd = shm_open(shm_name, O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    CatalogHeader *h;
+    size_t size;
+    bool ready = wait_until_ready(fd, &h, &size);
+    close(fd);
+
+    if (!ready) return false;
+
+    if (memcmp(h->magic, CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) != 0 || h->size != size) {
+        munmap(h, size);
+        return false;
+    }
+
+    char *base = (char *)h;
+    CatalogSection *sections = (CatalogSection *)(base + h->sections);
+    CatalogOption *options = (CatalogOption *)(base + h->options);
+    size_t const n = h->section_count;
+
+    size_t spilled = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (sections[i].option_count > SECTION_INLINE_OPTIONS) spilled += sections[i].option_count;
+    }
+
+    Adventure adv = (Adventure){
+        .title = base + h->title,
+        .author = base + h->author,
+        .version = base + h->version,
+        .section_count = n,
+        .sections = malloc(sizeof(Section) * n),
+        .option_pool_size = spilled,
+        .option_pool = spilled > 0 ? malloc(sizeof(Option) * spilled) : NULL,
+        .id_index_size = h->id_index_size,
+        .id_index = (uint32_t *)(base + h->id_index),
+        .ending_distance = (uint32_t *)(base + h->ending_distance),
+        .hint_option = (uint8_t *)(base + h->hint_option),
+        .content_hash = h->content_hash,
+    };
+
+    if (adv.sections == NULL || (spilled > 0 && adv.option_pool == NULL)) {
+        printf("Fatal error: can't malloc catalog sections.");
+        exit(1);
+    }
+
+    Option *pool_end = adv.option_pool;
+    for (size_t i = 0; i < n; ++i) {
+        Section s = (Section){
+            .text = base + sections[i].text,
+            .id = sections[i].id,
+            .option_count = sections[i].option_count,
+        };
+
+        if (s.option_count > SECTION_INLINE_OPTIONS) {
+            s.spilled_options = pool_end;
+            pool_end += s.option_count;
+        }
+
+        Option *o = section_options(&s);
+        for (size_t j = 0; j < s.option_count; ++j) {
+            CatalogOption *co = &options[sections[i].first_option + j];
+            o[j] = (Option){ .text = base + co->text, .section_id = co->section_id };
+        }
+
+        adv.sections[i] = s;
+    }
+
+    adv.current_section = adv.sections;
+    *c = (Catalog){ .adv = adv, .base = base, .size = size };
+    return true;
+}
+
+/*
+ * Whether c was published from source as it is now.
+ */
+bool catalog_from(Catalog *c, struct stat *source) {
+    CatalogHeader *h = c->base;
+    return h->source_inode == source->st_ino && h->source_size == (uint64_t)source->st_size &&
+        h->source_mtime == mtime_ns(source);
+}
+
+/*
+ * Records that the segment c was mapped from now matches source, for
+ * a file that was touched without changing. Leaves it alone if it was
+ * replaced meanwhile. Returns whether it was updated.
+ */
+bool catalog_update_source(char *name, Catalog *c, struct stat *source) {
+    char shm_name[256];
+    segment_name(name, shm_name, sizeof(shm_name));
+
+    int fd = shm_open(shm_name, O_RDWR, 0);
+    if (fd < 0) return false;
+
+    CatalogHeader *h = mmap(NULL, sizeof(CatalogHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) return false;
+
+    CatalogHeader *mapped = c->base;
+    bool const same = atomic_load(&h->ready) && h->size == mapped->size && h->content_hash == mapped->content_hash;
+
+    if (same) {
+        h->source_inode = source->st_ino;
+        h->source_size = source->st_size;
+        h->source_mtime = mtime_ns(source);
+    }
+    munmap(h, sizeof(CatalogHeader));
+    return same;
+}
+
+/*
+ * Unmaps a catalog adventure. Don't use free_adventure on it.
+ */
+void catalog_close(Catalog *c) {
+    free(c->adv.sections);
+    free(c->adv.option_pool);
+    munmap(c->base, c->size);
+    *c = (Catalog){};
+}
+
+/*
+ * Removes a published segment. Processes that mapped it keep their copy.
+ */
+void catalog_remove(char *name) {
+    char shm_name[256];
+    shm_unlink(segment_name(name, shm_name, sizeof(shm_name)));
+}
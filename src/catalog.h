@@ -0,0 +1,69 @@
+#ifndef TEXT_ADVENTURES_CATALOG
+#define TEXT_ADVENTURES_CATALOG
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "parse.h"
+
+/*
+ * Layout of an adventure in a shared memory segment.
+ * Every reference is an offset from the start of the segment,
+ * so each process can map it wherever it likes.
+ */
+typedef struct CatalogHeader {
+    char magic[8];
+    _Atomic uint32_t ready; // set once the publisher is done writing
+    int32_t publisher;      // its pid, to tell when it died halfway
+    uint32_t section_count;
+    uint32_t reserved;
+    uint64_t size;
+    uint64_t title, author, version;
+    uint64_t sections;        // CatalogSection[section_count]
+    uint64_t options;         // CatalogOption[], in section order
+    uint64_t id_index;        // uint32_t[id_index_size]
+    uint64_t id_index_size;
+    uint64_t ending_distance; // uint32_t[section_count]
+    uint64_t hint_option;     // uint8_t[section_count]
+    uint64_t content_hash;
+
+    // the file it was published from, to tell when that changed
+    uint64_t source_inode;
+    uint64_t source_size;
+    int64_t source_mtime;   // ns
+} CatalogHeader;
+
+typedef struct CatalogSection {
+    uint64_t text;
+    uint32_t id;
+    uint32_t option_count;
+    uint64_t first_option;
+} CatalogSection;
+
+typedef struct CatalogOption {
+    uint64_t text;
+    uint64_t section_id;
+} CatalogOption;
+
+typedef struct Catalog {
+    Adventure adv; // text and tables point into the mapping
+    void *base;
+    size_t size;
+} Catalog;
+
+enum CatalogResult {
+    CATALOG_OK,
+    CATALOG_EXISTS, // someone else published it first
+    CATALOG_ERROR,
+};
+
+enum CatalogResult catalog_publish(char *name, Adventure *adv, struct stat *source);
+bool catalog_open(char *name, Catalog *c);
+bool catalog_from(Catalog *c, struct stat *source);
+bool catalog_update_source(char *name, Catalog *c, struct stat *source);
+void catalog_close(Catalog *c);
+void catalog_remove(char *name);
+
+#endif // TEXT_ADVENTURES_CATALOG
@@ -0,0 +1,424 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "parse.h"
+#include "choicelog.h"
+
+#define CHOICE_LOG_INITIAL_BATCH 256
+
+static bool write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+
+    while (len > 0) {
+        ssize_t const n = write(fd, p, len);
+        if (n < 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Writes and syncs batches of records until the log is closed.
+ */
+static void *commit_choices(void *arg) {
+    ChoiceLog *log = arg;
+    pthread_mutex_lock(&log->lock);
+
+    while (true) {
+        while (log->pending_len == 0 && !log->stopping) {
+            pthread_cond_wait(&log->appended, &log->lock);
+        }
+        if (log->pending_len == 0) {
+            break; // stopping, and everything is written
+        }
+
+        // appenders go on filling the other buffer meanwhile
+        ChoiceRecord *batch = log->pending;
+        size_t const batch_capacity = log->pending_capacity;
+        size_t const n = log->pending_len;
+        uint64_t const upto = log->appended_count;
+
+        log->pending = log->writing;
+        log->pending_capacity = log->writing_capacity;
+        log->pending_len = 0;
+        log->writing = batch;
+        log->writing_capacity = batch_capacity;
+        pthread_mutex_unlock(&log->lock);
+
+        bool const ok = write_all(log->fd, batch, sizeof(ChoiceRecord) * n) && fdatasync(log->fd) == 0;
+
+        pthread_mutex_lock(&log->lock);
+        log->failed |= !ok;
+        log->durable_count = upto;
+        log->commits++;
+        pthread_cond_broadcast(&log->committed);
+    }
+
+    pthread_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+/*
+ * One past the largest session id in the first count records of fd.
+ */
+static bool next_logged_session(int fd, size_t count, uint32_t *next) {
+    ChoiceRecord chunk[CHOICE_LOG_INITIAL_BATCH];
+    off_t at = sizeof(ChoiceLogHeader);
+    *next = 0;
+
+    while (count > 0) {
+        size_t const n = count < CHOICE_LOG_INITIAL_BATCH ? count : CHOICE_LOG_INITIAL_BATCH;
+        if (pread(fd, chunk, sizeof(ChoiceRecord) * n, at) != (ssize_t)(sizeof(ChoiceRecord) * n)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            if (chunk[i].session != CHOICE_LOG_NO_SESSION && chunk[i].session >= *next) {
+                *next = chunk[i].session + 1;
+            }
+        }
+        at += sizeof(ChoiceRecord) * n;
+        count -= n;
+    }
+    return true;
+}
+
+/*
+ * Opens the choice log in filename for appending, creating it if it's
+ * missing. A record cut short by a crash is dropped. Sessions get ids
+ * after the ones already logged, so runs never share one.
+ */
+enum ChoiceLogResult choice_log_open(ChoiceLog *log, char *filename, Adventure *adv) {
+    *log = (ChoiceLog){};
+
+    log->fd = open(filename, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat s;
+
+    if (log->fd < 0 || fstat(log->fd, &s) != 0) {
+        if (log->fd >= 0) close(log->fd);
+        return CHOICE_LOG_ERROR;
+    }
+
+    ChoiceLogHeader h = (ChoiceLogHeader){
+        .magic = CHOICE_LOG_MAGIC,
+        .content_hash = adv->content_hash,
+        .record_size = sizeof(ChoiceRecord),
+    };
+
+    if (s.st_size == 0) {
+        if (!write_all(log->fd, &h, sizeof(h)) || fdatasync(log->fd) != 0) {
+            close(log->fd);
+            return CHOICE_LOG_ERROR;
+        }
+
+    } else {
+        ChoiceLogHeader found;
+        bool const read_ok = pread(log->fd, &found, sizeof(found), 0) == sizeof(found);
+
+        if (!read_ok || memcmp(found.magic, CHOICE_LOG_MAGIC, sizeof(found.magic)) != 0 ||
+            found.record_size != sizeof(ChoiceRecord)) {
+            close(log->fd);
+            return CHOICE_LOG_ERROR;
+        }
+
+        if (found.content_hash != adv->content_hash) {
+            close(log->fd);
+            return CHOICE_LOG_OTHER_ADVENTURE;
+        }
+
+        size_t const torn = (s.st_size - sizeof(h)) % sizeof(ChoiceRecord);
+        if (torn > 0 && ftruncate(log->fd, s.st_size - torn) != 0) {
+            close(log->fd);
+            return CHOICE_LOG_ERROR;
+        }
+
+        uint32_t next;
+        if (!next_logged_session(log->fd, (s.st_size - sizeof(h)) / sizeof(ChoiceRecord), &next)) {
+            close(log->fd);
+            return CHOICE_LOG_ERROR;
+        }
+        log->next_session = next;
+    }
+
+    log->pending_capacity = log->writing_capacity = CHOICE_LOG_INITIAL_BATCH;
+    log->pending = malloc(sizeof(ChoiceRecord) * log->pending_capacity);
+    log->writing = malloc(sizeof(ChoiceRecord) * log->writing_capacity);
+
+    if (log->pending == NULL || log->writing == NULL) {
+        printf("Fatal error: can't malloc choice log.");
+        exit(1);
+    }
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->appended, NULL);
+    pthread_cond_init(&log->committed, NULL);
+    pthread_create(&log->committer, NULL, commit_choices, log);
+    return CHOICE_LOG_OK;
+}
+
+/*
+ * Hands out an id to log a new session's choices under.
+ */
+uint32_t choice_log_session(ChoiceLog *log) {
+    return atomic_fetch_add(&log->next_session, 1);
+}
+
+/*
+ * Logs that session took option from section from to section to.
+ * Doesn't wait for the record to be on disk, see choice_log_sync.
+ */
+void choice_log_append(ChoiceLog *log, uint32_t session, uint32_t from, uint32_t to, uint8_t option) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    ChoiceRecord const r = (ChoiceRecord){
+        .session = session,
+        .from = from,
+        .to = to,
+        .option = option,
+        .time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec,
+    };
+
+    pthread_mutex_lock(&log->lock);
+
+    if (log->pending_len == log->pending_capacity) {
+        log->pending_capacity *= 2;
+        ChoiceRecord *p = realloc(log->pending, sizeof(ChoiceRecord) * log->pending_capacity);
+
+        if (p == NULL) {
+            printf("Fatal error: can't realloc choice log.");
+            exit(1);
+        }
+        log->pending = p;
+    }
+
+    log->pending[log->pending_len++] = r;
+    log->appended_count++;
+    pthread_cond_signal(&log->appended);
+    pthread_mutex_unlock(&log->lock);
+}
+
+/*
+ * Waits until every record appended so far is on disk.
+ * Returns false if some of them couldn't be written.
+ */
+bool choice_log_sync(ChoiceLog *log) {
+    pthread_mutex_lock(&log->lock);
+
+    uint64_t const target = log->appended_count;
+    while (log->durable_count < target) {
+        pthread_cond_wait(&log->committed, &log->lock);
+    }
+    bool const ok = !log->failed;
+
+    pthread_mutex_unlock(&log->lock);
+    return ok;
+}
+
+/*
+ * Commits what's left and closes the log.
+ */
+void choice_log_close(ChoiceLog *log) {
+    pthread_mutex_lock(&log->lock);
+    log->stopping = true;
+    pthread_cond_signal(&log->appended);
+    pthread_mutex_unlock(&log->lock);
+
+    pthread_join(log->committer, NULL);
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->appended);
+    pthread_cond_destroy(&log->committed);
+
+    close(log->fd);
+    free(log->pending);
+    free(log->writing);
+    *log = (ChoiceLog){ .fd = -1 };
+}
+
+/*
+ * Where a session got to, replaying the log.
+ */
+typedef struct ReplayedSession {
+    bool seen;
+    bool ended;
+    uint32_t section;
+    uint32_t choices;      // since the session last started over
+    size_t first_record;   // of the current run
+    uint64_t time;         // of the last choice
+} ReplayedSession;
+
+static bool read_log(char *filename, char **data, size_t *len) {
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL) {
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    *data = malloc(*len > 0 ? *len : 1);
+    if (*data == NULL) {
+        printf("Fatal error: can't malloc choice log.");
+        exit(1);
+    }
+
+    bool const ok = fread(*data, 1, *len, f) == *len;
+    fclose(f);
+    return ok;
+}
+
+/*
+ * Rebuilds where every session in the log got to and prints it.
+ * A session starts over whenever a choice doesn't follow from where it
+ * was, or after an ending. With rewrite set, the log is rewritten with
+ * only the records needed to rebuild the sessions that haven't ended.
+ * The log shouldn't be in use meanwhile.
+ */
+bool compact_choice_log(char *filename, Adventure *adv, bool rewrite) {
+    char *data;
+    size_t len;
+
+    if (!read_log(filename, &data, &len)) {
+        printf("Can't read the choice log!\n");
+        return false;
+    }
+
+    ChoiceLogHeader h = (ChoiceLogHeader){};
+    if (len >= sizeof(h)) {
+        memcpy(&h, data, sizeof(h));
+    }
+
+    if (memcmp(h.magic, CHOICE_LOG_MAGIC, sizeof(h.magic)) != 0 || h.record_size != sizeof(ChoiceRecord)) {
+        printf("Not a choice log!\n");
+        free(data);
+        return false;
+    }
+
+    if (h.content_hash != adv->content_hash) {
+        printf("The choice log is for another adventure!\n");
+        free(data);
+        return false;
+    }
+
+    ChoiceRecord *records = (ChoiceRecord *)(data + sizeof(h));
+    size_t const count = (len - sizeof(h)) / sizeof(ChoiceRecord);
+    bool *keep = calloc(count > 0 ? count : 1, sizeof(bool));
+    ReplayedSession *sessions = NULL;
+    size_t session_capacity = 0, bad = 0, runs = 0, finished = 0;
+
+    if (keep == NULL) {
+        printf("Fatal error: can't calloc choice log.");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        ChoiceRecord *r = &records[i];
+
+        Section *from = r->from < adv->section_count ? &adv->sections[r->from] : NULL;
+        Section *to = from != NULL && r->option < from->option_count
+            ? find_section(adv, section_options(from)[r->option].section_id)
+            : NULL;
+
+        if (to == NULL || (uint32_t)(to - adv->sections) != r->to || r->session == CHOICE_LOG_NO_SESSION) {
+            r->session = UINT32_MAX; // never kept
+            bad++;
+            continue;
+        }
+
+        if (r->session >= session_capacity) {
+            size_t const capacity = r->session + 1 > session_capacity * 2 ? r->session + 1 : session_capacity * 2;
+            ReplayedSession *p = realloc(sessions, sizeof(ReplayedSession) * capacity);
+
+            if (p == NULL) {
+                printf("Fatal error: can't realloc replayed sessions.");
+                exit(1);
+            }
+            memset(p + session_capacity, 0, sizeof(ReplayedSession) * (capacity - session_capacity));
+            sessions = p;
+            session_capacity = capacity;
+        }
+
+        ReplayedSession *s = &sessions[r->session];
+        if (!s->seen || s->ended || s->section != r->from) {
+            *s = (ReplayedSession){ .seen = true, .first_record = i };
+            runs++;
+        }
+
+        s->section = r->to;
+        s->choices++;
+        s->time = r->time;
+        s->ended = to->option_count == 0;
+        finished += s->ended;
+    }
+
+    size_t live = 0, kept = 0;
+    for (size_t id = 0; id < session_capacity; ++id) {
+        ReplayedSession *s = &sessions[id];
+        if (!s->seen || s->ended) continue;
+
+        time_t const t = s->time / 1000000000;
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        printf(
+            "session %zu: section %zu after %u choice(s), last at %s\n",
+            id, adv->sections[s->section].id, s->choices, when
+        );
+        live++;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        ChoiceRecord *r = &records[i];
+        if (r->session >= session_capacity) continue;
+
+        ReplayedSession *s = &sessions[r->session];
+        keep[i] = s->seen && !s->ended && i >= s->first_record;
+        kept += keep[i];
+    }
+
+    printf(
+        "%zu choices in %zu runs: %zu ended, %zu still playing, %zu bad record(s)\n",
+        count - bad, runs, finished, live, bad
+    );
+
+    bool ok = true;
+    if (rewrite) {
+        char tmp[4096];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        ok = fd >= 0 && write_all(fd, &h, sizeof(h));
+
+        for (size_t i = 0; ok && i < count; ++i) {
+            if (keep[i]) ok = write_all(fd, &records[i], sizeof(ChoiceRecord));
+        }
+
+        if (fd >= 0) {
+            ok = ok && fsync(fd) == 0;
+            close(fd);
+        }
+        ok = ok && rename(tmp, filename) == 0;
+
+        if (ok) {
+            printf("kept %zu of %zu records\n", kept, count);
+        } else {
+            printf("Can't rewrite the choice log!\n");
+            unlink(tmp);
+        }
+    }
+
+    free(sessions);
+    free(keep);
+    free(data);
+    return ok;
+}
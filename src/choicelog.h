@@ -0,0 +1,70 @@
+#ifndef TEXT_ADVENTURES_CHOICELOG
+#define TEXT_ADVENTURES_CHOICELOG
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "parse.h"
+
+#define CHOICE_LOG_MAGIC "ADVLOG1"
+#define CHOICE_LOG_NO_SESSION UINT32_MAX
+
+/*
+ * A choice log file starts with this header, then has one record
+ * per option taken, in the order they were taken.
+ */
+typedef struct ChoiceLogHeader {
+    char magic[8];
+    uint64_t content_hash; // Adventure.content_hash the sections belong to
+    uint32_t record_size;
+    uint32_t reserved;
+} ChoiceLogHeader;
+
+typedef struct ChoiceRecord {
+    uint32_t session;
+    uint32_t from;    // section indices
+    uint32_t to;
+    uint8_t option;   // index in from's options
+    uint8_t reserved[3];
+    uint64_t time;    // wall clock, ns since the epoch
+} ChoiceRecord;
+
+/*
+ * Appending only copies the record into memory. A committer thread
+ * writes whatever piled up meanwhile and fdatasyncs it, so a whole
+ * batch of choices, from every session, costs one sync.
+ */
+typedef struct ChoiceLog {
+    int fd;
+    pthread_t committer;
+    pthread_mutex_t lock;
+    pthread_cond_t appended;  // the committer has work, or should stop
+    pthread_cond_t committed; // a batch was synced
+    ChoiceRecord *pending, *writing; // swapped by the committer
+    size_t pending_len, pending_capacity, writing_capacity;
+    uint64_t appended_count;  // records appended so far
+    uint64_t durable_count;   // records synced so far
+    bool stopping, failed;
+    _Atomic uint32_t next_session; // after every session already logged
+
+    // stats
+    size_t commits;
+} ChoiceLog;
+
+enum ChoiceLogResult {
+    CHOICE_LOG_OK,
+    CHOICE_LOG_OTHER_ADVENTURE, // the file logs another adventure
+    CHOICE_LOG_ERROR,
+};
+
+enum ChoiceLogResult choice_log_open(ChoiceLog *log, char *filename, Adventure *adv);
+uint32_t choice_log_session(ChoiceLog *log);
+void choice_log_append(ChoiceLog *log, uint32_t session, uint32_t from, uint32_t to, uint8_t option);
+bool choice_log_sync(ChoiceLog *log);
+void choice_log_close(ChoiceLog *log);
+bool compact_choice_log(char *filename, Adventure *adv, bool rewrite);
+
+#endif // TEXT_ADVENTURES_CHOICELOG
@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "parse.h"
+#include "intern.h"
+#include "compress.h"
+
+#define BLOB_PADDING 2 // the decoder may look up to 2 bytes past a blob
+
+static void *codec_alloc(size_t size) {
+    void *p = calloc(1, size);
+
+    if (p == NULL) {
+        printf("Fatal error: can't calloc text codec.");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * Computes Huffman code lengths for the byte frequencies.
+ * If some code ends up longer than CODE_MAX_BITS, the frequencies
+ * are flattened and the code is built again.
+ */
+static void code_lengths(size_t *freq, uint8_t *lengths) {
+    size_t weight[512];
+    int parent[512];
+    bool used[512];
+
+    while (true) {
+        int nodes = 0, leaf[256];
+
+        for (int i = 0; i < 256; ++i) {
+            lengths[i] = 0;
+            if (freq[i] == 0) continue;
+
+            leaf[i] = nodes;
+            weight[nodes] = freq[i];
+            parent[nodes] = -1;
+            used[nodes] = false;
+            nodes++;
+        }
+
+        int const leaves = nodes;
+        if (leaves == 0) return;
+        if (leaves == 1) {
+            for (int i = 0; i < 256; ++i) {
+                if (freq[i] != 0) lengths[i] = 1;
+            }
+            return;
+        }
+
+        // join the two lightest nodes until one is left
+        for (int joined = 0; joined < leaves - 1; ++joined) {
+            int a = -1, b = -1;
+
+            for (int i = 0; i < nodes; ++i) {
+                if (used[i]) continue;
+                if (a == -1 || weight[i] < weight[a]) {
+                    b = a;
+                    a = i;
+                } else if (b == -1 || weight[i] < weight[b]) {
+                    b = i;
+                }
+            }
+
+            used[a] = used[b] = true;
+            weight[nodes] = weight[a] + weight[b];
+            parent[nodes] = -1;
+            used[nodes] = false;
+            parent[a] = parent[b] = nodes;
+            nodes++;
+        }
+
+        int longest = 0;
+        for (int i = 0; i < 256; ++i) {
+            if (freq[i] == 0) continue;
+
+            int depth = 0;
+            for (int n = leaf[i]; parent[n] != -1; n = parent[n]) depth++;
+            lengths[i] = depth;
+            if (depth > longest) longest = depth;
+        }
+
+        if (longest <= CODE_MAX_BITS) return;
+
+        for (int i = 0; i < 256; ++i) {
+            if (freq[i] != 0) freq[i] = (freq[i] >> 1) | 1;
+        }
+    }
+}
+
+/*
+ * Assigns canonical codes from the lengths and fills the decode table.
+ */
+static void build_codec(TextCodec *c, size_t *freq) {
+    code_lengths(freq, c->lengths);
+
+    uint16_t code = 0;
+    for (int len = 1; len <= CODE_MAX_BITS; ++len) {
+        for (int sym = 0; sym < 256; ++sym) {
+            if (c->lengths[sym] != len) continue;
+
+            c->codes[sym] = code;
+            uint16_t const first = code << (CODE_MAX_BITS - len);
+            uint16_t const count = 1 << (CODE_MAX_BITS - len);
+
+            for (uint16_t i = 0; i < count; ++i) {
+                c->decode[first + i] = sym << 4 | len;
+            }
+            code++;
+        }
+        code <<= 1;
+    }
+}
+
+static size_t varint_size(size_t n) {
+    size_t size = 1;
+    while (n >= 0x80) {
+        n >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static size_t encoded_size(TextCodec *c, char *text, size_t *len) {
+    size_t bits = 0;
+    char *t = text;
+
+    for (; *t; ++t) bits += c->lengths[(unsigned char)*t];
+    *len = t - text;
+    return varint_size(*len) + (bits + 7) / 8;
+}
+
+static void encode_text(TextCodec *c, char *text, size_t len, uint8_t *out) {
+    size_t n = len;
+    while (n >= 0x80) {
+        *out++ = (n & 0x7F) | 0x80;
+        n >>= 7;
+    }
+    *out++ = n;
+
+    uint32_t buffer = 0;
+    int bits = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char const sym = text[i];
+        buffer = buffer << c->lengths[sym] | c->codes[sym];
+        bits += c->lengths[sym];
+
+        while (bits >= 8) {
+            bits -= 8;
+            *out++ = buffer >> bits;
+        }
+    }
+
+    if (bits > 0) {
+        *out = buffer << (8 - bits);
+    }
+}
+
+/*
+ * Decompresses a blob into the codec's scratch buffer.
+ */
+char *decode_text(TextCodec *c, char *blob) {
+    uint8_t const *in = (uint8_t *)blob;
+    size_t len = 0;
+
+    for (int shift = 0;; shift += 7) {
+        len |= (size_t)(*in & 0x7F) << shift;
+        if (!(*in++ & 0x80)) break;
+    }
+
+    if (c->scratch_size < len + 1) {
+        free(c->scratch);
+        c->scratch_size = len + 1;
+        c->scratch = malloc(c->scratch_size);
+
+        if (c->scratch == NULL) {
+            printf("Fatal error: can't malloc text scratch buffer.");
+            exit(1);
+        }
+    }
+
+    uint64_t buffer = 0;
+    int bits = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        while (bits < CODE_MAX_BITS) {
+            buffer = buffer << 8 | *in++;
+            bits += 8;
+        }
+
+        uint16_t const e = c->decode[(buffer >> (bits - CODE_MAX_BITS)) & ((1 << CODE_MAX_BITS) - 1)];
+        c->scratch[i] = e >> 4;
+        bits -= e & 0xF;
+    }
+
+    c->scratch[len] = 0;
+    return c->scratch;
+}
+
+static int compare_text_pointers(const void *a, const void *b) {
+    char *ta = (*(Section **)a)->text, *tb = (*(Section **)b)->text;
+    return (ta > tb) - (ta < tb);
+}
+
+/*
+ * Replaces every section's text with its compressed form.
+ * Interned text is compressed once and shared. Option text moves to a
+ * new string pool, so the plain section text can be released.
+ */
+void compress_adventure(Adventure *adv) {
+    TextCodec *c = codec_alloc(sizeof(TextCodec));
+    size_t const n = adv->section_count;
+    size_t freq[256] = {0};
+
+    // group sections by text, so shared text is handled once
+    Section **order = codec_alloc(sizeof(Section *) * (n + 1));
+    for (size_t i = 0; i < n; ++i) order[i] = &adv->sections[i];
+    qsort(order, n, sizeof(Section *), compare_text_pointers);
+
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0 && order[i]->text == order[i - 1]->text) continue;
+        for (char *t = order[i]->text; *t; ++t) freq[(unsigned char)*t]++;
+    }
+    build_codec(c, freq);
+
+    size_t *offsets = codec_alloc(sizeof(size_t) * (n + 1));
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0 && order[i]->text == order[i - 1]->text) continue;
+
+        size_t len;
+        offsets[i] = c->blob_size;
+        c->blob_size += encoded_size(c, order[i]->text, &len);
+        c->plain_bytes += len + 1;
+    }
+
+    c->blobs = codec_alloc(c->blob_size + BLOB_PADDING);
+    c->compressed_bytes = c->blob_size;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (i > 0 && order[i]->text == order[i - 1]->text) {
+            offsets[i] = offsets[i - 1];
+        } else {
+            size_t len = strlen(order[i]->text);
+            encode_text(c, order[i]->text, len, (uint8_t *)c->blobs + offsets[i]);
+        }
+    }
+
+    // options keep plain text, in a pool of their own
+    StringPool *strings = new_string_pool();
+    for (size_t i = 0; i < n; ++i) {
+        Option *options = section_options(&adv->sections[i]);
+
+        for (size_t j = 0; j < adv->sections[i].option_count; ++j) {
+            options[j].text = intern_string(strings, strdup(options[j].text));
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        order[i]->text = c->blobs + offsets[i];
+    }
+
+    free_string_pool(adv->strings);
+    adv->strings = strings;
+    adv->codec = c;
+
+    free(order);
+    free(offsets);
+}
+
+void free_text_codec(TextCodec *c) {
+    if (c == NULL) return;
+
+    free(c->blobs);
+    free(c->scratch);
+    free(c);
+}
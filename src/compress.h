@@ -0,0 +1,43 @@
+#ifndef TEXT_ADVENTURES_COMPRESS
+#define TEXT_ADVENTURES_COMPRESS
+
+#include <stdint.h>
+
+#include "parse.h"
+
+#define CODE_MAX_BITS 12 // longest Huffman code, sets the decode table size
+
+/*
+ * Static Huffman code trained on an adventure's section text.
+ * Compressed text is a varint with the decoded length followed by
+ * the code bits, most significant bit first.
+ */
+typedef struct TextCodec {
+    uint16_t decode[1 << CODE_MAX_BITS]; // symbol << 4 | code length
+    uint16_t codes[256];
+    uint8_t lengths[256];
+
+    char *blobs; // compressed text of every section
+    size_t blob_size;
+
+    char *scratch; // last decoded text
+    size_t scratch_size;
+
+    // stats
+    size_t plain_bytes;
+    size_t compressed_bytes;
+} TextCodec;
+
+void compress_adventure(Adventure *adv);
+char *decode_text(TextCodec *c, char *blob);
+void free_text_codec(TextCodec *c);
+
+/*
+ * Returns the section's text, decompressing it if needed.
+ * Decompressed text is only valid until the next call.
+ */
+static inline char *section_text(Adventure *adv, Section *s) {
+    return adv->codec != NULL ? decode_text(adv->codec, s->text) : s->text;
+}
+
+#endif // TEXT_ADVENTURES_COMPRESS
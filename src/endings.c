@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "parse.h"
+#include "graph.h"
+#include "endings.h"
+
+static void *endings_alloc(size_t size) {
+    void *p = calloc(1, size > 0 ? size : 1);
+
+    if (p == NULL) {
+        printf("Fatal error: can't calloc ending odds.");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * Solves x = in + W x for the nodes of one cycle, where W[v][u] is the
+ * chance of u moving to v, by Gaussian elimination on I - W.
+ */
+static void solve_dense(Graph *g, uint32_t *nodes, uint32_t size, uint32_t *component, uint32_t c,
+                        uint32_t *position, double *in, double *x) {
+    double *a = endings_alloc(sizeof(double) * size * (size + 1)); // augmented with in
+    size_t const row = size + 1;
+
+    for (uint32_t i = 0; i < size; ++i) {
+        a[i * row + i] = 1;
+        a[i * row + size] = in[nodes[i]];
+    }
+
+    for (uint32_t j = 0; j < size; ++j) {
+        uint32_t const u = nodes[j];
+        double const chance = 1.0 / graph_degree(g, u);
+
+        for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+            uint32_t const v = g->targets[e];
+            if (component[v] == c) {
+                a[position[v] * row + j] -= chance;
+            }
+        }
+    }
+
+    for (uint32_t k = 0; k < size; ++k) {
+        uint32_t pivot = k;
+        for (uint32_t i = k + 1; i < size; ++i) {
+            if (fabs(a[i * row + k]) > fabs(a[pivot * row + k])) pivot = i;
+        }
+        if (pivot != k) {
+            for (uint32_t j = 0; j <= size; ++j) {
+                double const swap = a[k * row + j];
+                a[k * row + j] = a[pivot * row + j];
+                a[pivot * row + j] = swap;
+            }
+        }
+
+        for (uint32_t i = k + 1; i < size; ++i) {
+            double const f = a[i * row + k] / a[k * row + k];
+            if (f == 0) continue;
+            for (uint32_t j = k; j <= size; ++j) {
+                a[i * row + j] -= f * a[k * row + j];
+            }
+        }
+    }
+
+    for (uint32_t i = size; i-- > 0;) {
+        double sum = a[i * row + size];
+        for (uint32_t j = i + 1; j < size; ++j) {
+            sum -= a[i * row + j] * x[nodes[j]];
+        }
+        x[nodes[i]] = sum / a[i * row + i];
+    }
+
+    free(a);
+}
+
+/*
+ * y = (I - W) x, for vectors indexed by position within one cycle.
+ */
+static void cycle_apply(Graph *g, uint32_t *nodes, uint32_t size, uint32_t *component, uint32_t c,
+                        uint32_t *position, double *x, double *y) {
+    memcpy(y, x, sizeof(double) * size);
+
+    for (uint32_t i = 0; i < size; ++i) {
+        uint32_t const u = nodes[i];
+        double const share = x[i] / graph_degree(g, u);
+
+        for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+            if (component[g->targets[e]] == c) y[position[g->targets[e]]] -= share;
+        }
+    }
+}
+
+static double dot(double *a, double *b, uint32_t size) {
+    double sum = 0;
+    for (uint32_t i = 0; i < size; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+static double norm1(double *a, uint32_t size) {
+    double sum = 0;
+    for (uint32_t i = 0; i < size; ++i) sum += fabs(a[i]);
+    return sum;
+}
+
+/*
+ * Orders the nodes of one cycle breadth first from where chance flows
+ * into it, so that a sweep in that order carries it all the way round.
+ */
+static void order_by_flow(Graph *g, uint32_t *nodes, uint32_t size, uint32_t *component, uint32_t c,
+                          uint32_t *position, double *in) {
+    uint32_t *order = endings_alloc(sizeof(uint32_t) * size);
+    uint32_t head = 0, tail = 0;
+
+    for (uint32_t i = 0; i < size; ++i) {
+        position[nodes[i]] = NO_COMPONENT;
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+        if (in[nodes[i]] != 0) {
+            position[nodes[i]] = tail;
+            order[tail++] = nodes[i];
+        }
+    }
+    if (tail == 0) {
+        position[nodes[0]] = 0;
+        order[tail++] = nodes[0];
+    }
+
+    while (head < tail) {
+        uint32_t const u = order[head++];
+        for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+            uint32_t const t = g->targets[e];
+            if (component[t] == c && position[t] == NO_COMPONENT) {
+                position[t] = tail;
+                order[tail++] = t;
+            }
+        }
+    }
+
+    memcpy(nodes, order, sizeof(uint32_t) * size);
+    free(order);
+}
+
+/*
+ * One Gauss-Seidel sweep from zero: solves (D - L) y = p, where L is
+ * the part of W going forward in the order of nodes.
+ */
+static void cycle_sweep(Graph *g, uint32_t *nodes, uint32_t size, uint32_t *component, uint32_t c,
+                        uint32_t *position, double *diagonal, double *p, double *y) {
+    memcpy(y, p, sizeof(double) * size);
+
+    for (uint32_t i = 0; i < size; ++i) {
+        uint32_t const u = nodes[i];
+        y[i] /= diagonal[i];
+        double const share = y[i] / graph_degree(g, u);
+
+        for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+            uint32_t const t = g->targets[e];
+            if (component[t] == c && position[t] > i) y[position[t]] += share;
+        }
+    }
+}
+
+/*
+ * Solves (I - W) x = in for the nodes of one cycle with BiCGSTAB,
+ * preconditioned by a Gauss-Seidel sweep in the order chance flows
+ * through the cycle: on its own a sweep carries it round once, and
+ * BiCGSTAB makes up for what goes against the order. It stops once the
+ * residual is below ENDINGS_TOLERANCE of the chance flowing in, checked
+ * against a freshly computed residual since the one BiCGSTAB keeps up
+ * to date drifts. Returns false when that doesn't happen within
+ * ENDINGS_MAX_ITERATIONS.
+ */
+static bool solve_iteratively(Graph *g, uint32_t *nodes, uint32_t size, uint32_t *component, uint32_t c,
+                              uint32_t *position, double *in, double *x, EndingOdds *odds) {
+    double *work = endings_alloc(sizeof(double) * size * 10);
+    double *b = work, *xs = b + size, *diagonal = xs + size, *r = diagonal + size, *rhat = r + size;
+    double *p = rhat + size, *v = p + size, *y = v + size, *z = y + size, *t = z + size;
+
+    order_by_flow(g, nodes, size, component, c, position, in);
+
+    for (uint32_t i = 0; i < size; ++i) {
+        uint32_t const u = nodes[i];
+        uint32_t loops = 0;
+        for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+            loops += g->targets[e] == u;
+        }
+        diagonal[i] = 1 - (double)loops / graph_degree(g, u);
+        b[i] = in[u];
+    }
+    cycle_sweep(g, nodes, size, component, c, position, diagonal, b, xs);
+
+    double const inflow = norm1(b, size), goal = ENDINGS_TOLERANCE * inflow;
+    double residual = 0;
+    size_t iterations = 0;
+    bool converged = false;
+
+    // restarts whenever the recurrence breaks down or drifts
+    while (true) {
+        cycle_apply(g, nodes, size, component, c, position, xs, r);
+        for (uint32_t i = 0; i < size; ++i) {
+            r[i] = b[i] - r[i];
+        }
+        residual = norm1(r, size);
+        if (residual <= goal) {
+            converged = true;
+            break;
+        }
+        if (iterations >= ENDINGS_MAX_ITERATIONS) {
+            break;
+        }
+
+        memcpy(rhat, r, sizeof(double) * size);
+        memset(p, 0, sizeof(double) * size);
+        memset(v, 0, sizeof(double) * size);
+        double rho = 1, alpha = 1, omega = 1;
+
+        while (iterations < ENDINGS_MAX_ITERATIONS) {
+            iterations++;
+
+            double const rho_next = dot(rhat, r, size);
+            if (rho_next == 0 || omega == 0) break;
+
+            double const beta = rho_next / rho * alpha / omega;
+            for (uint32_t i = 0; i < size; ++i) {
+                p[i] = r[i] + beta * (p[i] - omega * v[i]);
+            }
+            cycle_sweep(g, nodes, size, component, c, position, diagonal, p, y);
+            cycle_apply(g, nodes, size, component, c, position, y, v);
+
+            double const rv = dot(rhat, v, size);
+            if (rv == 0) break;
+            alpha = rho_next / rv;
+            rho = rho_next;
+
+            for (uint32_t i = 0; i < size; ++i) {
+                xs[i] += alpha * y[i];
+                r[i] -= alpha * v[i]; // s, from here on
+            }
+            if (norm1(r, size) <= goal) break;
+
+            cycle_sweep(g, nodes, size, component, c, position, diagonal, r, z);
+
+            cycle_apply(g, nodes, size, component, c, position, z, t);
+            double const tt = dot(t, t, size);
+            omega = tt > 0 ? dot(t, r, size) / tt : 0;
+
+            for (uint32_t i = 0; i < size; ++i) {
+                xs[i] += omega * z[i];
+                r[i] -= omega * t[i];
+            }
+            if (norm1(r, size) <= goal) break;
+        }
+    }
+
+    for (uint32_t i = 0; i < size; ++i) {
+        x[nodes[i]] = xs[i];
+    }
+
+    odds->iterations += iterations;
+    double const relative = inflow > 0 ? residual / inflow : 0;
+    if (relative > odds->residual) odds->residual = relative;
+
+    free(work);
+    return converged;
+}
+
+/*
+ * Works out how likely each ending is, following the chance of being
+ * at each node from the start in topological order of the components.
+ * A node that isn't in a cycle is reached exactly as often as its
+ * predecessors lead to it. For cycles, how often each of their nodes
+ * is visited comes out of a linear system; cycles that can't be left
+ * and hold no ending keep whatever gets there forever.
+ */
+EndingOdds ending_odds(Graph *g) {
+    uint32_t const n = g->node_count;
+    EndingOdds odds = (EndingOdds){ .probability = endings_alloc(sizeof(double) * n), .converged = true };
+
+    if (n == 0) {
+        return odds;
+    }
+
+    uint32_t *component = endings_alloc(sizeof(uint32_t) * n);
+    uint32_t const count = graph_components(g, component);
+    odds.components = count;
+
+    // nodes grouped by component
+    uint32_t *members_first = endings_alloc(sizeof(uint32_t) * (count + 1));
+    uint32_t *members = endings_alloc(sizeof(uint32_t) * n);
+    uint32_t *position = endings_alloc(sizeof(uint32_t) * n); // index within its component
+
+    graph_component_members(g, component, count, members_first, members);
+    for (uint32_t i = 0; i < members_first[count]; ++i) {
+        position[members[i]] = i - members_first[component[members[i]]];
+    }
+
+    double *in = endings_alloc(sizeof(double) * n); // chance flowing in from earlier components
+    double *x = endings_alloc(sizeof(double) * n);  // expected visits
+    in[g->start] = 1;
+
+    for (uint32_t c = count; c-- > 0;) {
+        uint32_t *nodes = members + members_first[c];
+        uint32_t const size = members_first[c + 1] - members_first[c];
+
+        bool cyclic = size > 1, leaves = false;
+        for (uint32_t i = 0; i < size; ++i) {
+            uint32_t const u = nodes[i];
+            for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+                if (component[g->targets[e]] == c) cyclic = true;
+                else leaves = true;
+            }
+        }
+
+        if (cyclic) {
+            odds.cyclic++;
+            if (size > odds.largest) odds.largest = size;
+        }
+
+        if (!cyclic) {
+            x[nodes[0]] = in[nodes[0]];
+
+        } else if (!leaves) {
+            for (uint32_t i = 0; i < size; ++i) {
+                odds.never += in[nodes[i]];
+            }
+            continue;
+
+        } else {
+            if (size <= ENDINGS_DENSE_LIMIT) {
+                solve_dense(g, nodes, size, component, c, position, in, x);
+            } else {
+                odds.converged &= solve_iteratively(g, nodes, size, component, c, position, in, x, &odds);
+            }
+        }
+
+        for (uint32_t i = 0; i < size; ++i) {
+            uint32_t const u = nodes[i];
+            uint32_t const degree = graph_degree(g, u);
+
+            if (degree == 0) {
+                odds.probability[u] = x[u];
+                continue;
+            }
+
+            double const chance = x[u] / degree;
+            for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+                if (component[g->targets[e]] != c) in[g->targets[e]] += chance;
+            }
+        }
+    }
+
+    free(in);
+    free(x);
+    free(component);
+    free(members_first);
+    free(members);
+    free(position);
+    return odds;
+}
+
+void free_ending_odds(EndingOdds *o) {
+    free(o->probability);
+    *o = (EndingOdds){};
+}
+
+/*
+ * An ending and the chance of getting there, for sorting.
+ */
+typedef struct EndingChance {
+    uint32_t node;
+    double probability;
+} EndingChance;
+
+/*
+ * Most likely first, then in section order.
+ */
+static int compare_ending_chances(const void *a, const void *b) {
+    EndingChance const *x = a, *y = b;
+
+    if (x->probability != y->probability) {
+        return x->probability > y->probability ? -1 : 1;
+    }
+    return x->node < y->node ? -1 : x->node > y->node;
+}
+
+/*
+ * Entry point for adv endings: prints every ending that can be
+ * reached, most likely first.
+ */
+bool print_ending_odds(char *filename, bool compact) {
+    Adventure adv;
+    if (!load_adventure_file(filename, &adv)) {
+        return false;
+    }
+
+    Graph g = adventure_graph(&adv);
+    if (compact) {
+        Graph compacted = compact_graph(&g);
+        printf("%u sections compacted to %u nodes\n", g.node_count, compacted.node_count);
+        free_graph(&g);
+        g = compacted;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    EndingOdds odds = ending_odds(&g);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (g.segments != NULL) {
+        // each chain ends on its last section
+        double *probability = endings_alloc(sizeof(double) * g.original_count);
+        for (uint32_t i = 0; i < g.node_count; ++i) {
+            probability[graph_last_segment(&g, i)] = odds.probability[i];
+        }
+        free(odds.probability);
+        odds.probability = probability;
+    }
+
+    EndingChance *endings = endings_alloc(sizeof(EndingChance) * adv.section_count);
+    uint32_t reached = 0;
+    for (uint32_t v = 0; v < adv.section_count; ++v) {
+        if (odds.probability[v] > 0) endings[reached++] = (EndingChance){ .node = v, .probability = odds.probability[v] };
+    }
+    qsort(endings, reached, sizeof(EndingChance), compare_ending_chances);
+
+    printf("chance of each ending, every option equally likely:\n");
+    for (uint32_t i = 0; i < reached; ++i) {
+        printf("  section %-8zu %12.6g%%\n", adv.sections[endings[i].node].id, 100 * endings[i].probability);
+    }
+    if (odds.never > 0) {
+        printf("  never ends       %12.6g%%\n", 100 * odds.never);
+    }
+
+    double const ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    printf(
+        "\n%u components, %u with cycles (largest %u nodes), solved in %.2f ms",
+        odds.components, odds.cyclic, odds.largest, ms
+    );
+    if (odds.iterations > 0) {
+        printf(", %zu iterations to a residual of %.1e", odds.iterations, odds.residual);
+    }
+    printf("\n");
+
+    bool const converged = odds.converged;
+    if (!converged) {
+        printf(
+            "\nA cycle didn't converge in %d iterations: these odds are off by up to %.1e of what reaches it!\n",
+            ENDINGS_MAX_ITERATIONS, odds.residual
+        );
+    }
+
+    free(endings);
+    free_ending_odds(&odds);
+    free_graph(&g);
+    free_adventure(&adv);
+    return converged;
+}
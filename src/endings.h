@@ -0,0 +1,33 @@
+#ifndef TEXT_ADVENTURES_ENDINGS
+#define TEXT_ADVENTURES_ENDINGS
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parse.h"
+#include "graph.h"
+
+#define ENDINGS_DENSE_LIMIT 128      // bigger cycles are solved iteratively
+#define ENDINGS_MAX_ITERATIONS 10000
+#define ENDINGS_TOLERANCE 1e-12      // of the chance flowing into a cycle
+
+/*
+ * Exact odds of how a playthrough ends when every option is equally
+ * likely to be picked.
+ */
+typedef struct EndingOdds {
+    double *probability; // per node: of ending there, 0 for non-endings
+    double never;        // of getting stuck in a loop with no way out
+
+    // how the solution was found
+    uint32_t components, cyclic, largest;
+    size_t iterations;   // BiCGSTAB steps, over every big cycle
+    double residual;     // worst one left, relative to what flowed in
+    bool converged;      // false when a cycle couldn't be solved
+} EndingOdds;
+
+EndingOdds ending_odds(Graph *g);
+void free_ending_odds(EndingOdds *o);
+bool print_ending_odds(char *filename, bool compact);
+
+#endif // TEXT_ADVENTURES_ENDINGS
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "framecache.h"
+
+static size_t bucket_of(FrameCache *c, uint64_t version, uint32_t section, uint16_t width, uint8_t style) {
+    uint64_t h = version ^ ((uint64_t)section << 24 | (uint64_t)width << 8 | style);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    return h & (c->bucket_count - 1);
+}
+
+void frame_cache_init(FrameCache *c, size_t max_bytes) {
+    size_t buckets = 1;
+    while (buckets * FRAME_CACHE_BYTES_PER_BUCKET < max_bytes) buckets *= 2;
+
+    *c = (FrameCache){
+        .bucket_count = buckets,
+        .buckets = calloc(buckets, sizeof(CachedFrame *)),
+        .max_bytes = max_bytes,
+    };
+
+    if (c->buckets == NULL) {
+        printf("Fatal error: can't calloc frame cache.");
+        exit(1);
+    }
+    pthread_mutex_init(&c->lock, NULL);
+}
+
+static void unlink_lru(FrameCache *c, CachedFrame *f) {
+    if (f->newer) f->newer->older = f->older; else c->newest = f->older;
+    if (f->older) f->older->newer = f->newer; else c->oldest = f->newer;
+    f->newer = f->older = NULL;
+}
+
+static void push_newest(FrameCache *c, CachedFrame *f) {
+    f->older = c->newest;
+    f->newer = NULL;
+    if (c->newest) c->newest->newer = f; else c->oldest = f;
+    c->newest = f;
+}
+
+/*
+ * Drops the least recently used frames until the cache fits.
+ * Frames someone still holds are freed when they're released.
+ */
+static void evict(FrameCache *c) {
+    while (c->bytes > c->max_bytes && c->oldest != NULL) {
+        CachedFrame *f = c->oldest;
+        CachedFrame **p = &c->buckets[bucket_of(c, f->version, f->section, f->width, f->style)];
+
+        while (*p != f) p = &(*p)->chain;
+        *p = f->chain;
+        unlink_lru(c, f);
+
+        c->bytes -= sizeof(CachedFrame) + f->len;
+        c->entries--;
+        c->evictions++;
+
+        f->evicted = true;
+        if (f->refs == 0) {
+            free(f);
+        }
+    }
+}
+
+/*
+ * Looks a frame up, counting a hit or a miss.
+ * Returns it with a reference held, or NULL.
+ */
+CachedFrame *frame_cache_get(FrameCache *c, uint64_t version, uint32_t section, uint16_t width, enum FrameStyle style) {
+    pthread_mutex_lock(&c->lock);
+
+    CachedFrame *f = c->buckets[bucket_of(c, version, section, width, style)];
+    while (f != NULL && !(f->version == version && f->section == section && f->width == width && f->style == style)) {
+        f = f->chain;
+    }
+
+    if (f != NULL) {
+        unlink_lru(c, f);
+        push_newest(c, f);
+        f->refs++;
+        c->hits++;
+    } else {
+        c->misses++;
+    }
+
+    pthread_mutex_unlock(&c->lock);
+    return f;
+}
+
+/*
+ * Adds a frame the caller rendered and allocated (refs unset).
+ * If another thread added the same one meanwhile, that one is kept and
+ * rendered is freed. Returns the cached frame with a reference held.
+ */
+CachedFrame *frame_cache_put(FrameCache *c, CachedFrame *rendered) {
+    pthread_mutex_lock(&c->lock);
+
+    size_t const b = bucket_of(c, rendered->version, rendered->section, rendered->width, rendered->style);
+    CachedFrame *f = c->buckets[b];
+
+    while (f != NULL && !(f->version == rendered->version && f->section == rendered->section &&
+                          f->width == rendered->width && f->style == rendered->style)) {
+        f = f->chain;
+    }
+
+    if (f != NULL) {
+        free(rendered);
+    } else {
+        f = rendered;
+        f->refs = 0;
+        f->evicted = false;
+        f->chain = c->buckets[b];
+        c->buckets[b] = f;
+        push_newest(c, f);
+
+        c->bytes += sizeof(CachedFrame) + f->len;
+        c->entries++;
+    }
+
+    f->refs++;
+    evict(c); // f is the newest, it only goes if it alone doesn't fit
+    pthread_mutex_unlock(&c->lock);
+    return f;
+}
+
+void frame_cache_release(FrameCache *c, CachedFrame *f) {
+    pthread_mutex_lock(&c->lock);
+
+    if (--f->refs == 0 && f->evicted) {
+        free(f);
+    }
+
+    pthread_mutex_unlock(&c->lock);
+}
+
+void free_frame_cache(FrameCache *c) {
+    for (CachedFrame *f = c->oldest, *next; f != NULL; f = next) {
+        next = f->newer;
+        free(f);
+    }
+
+    free(c->buckets);
+    pthread_mutex_destroy(&c->lock);
+    *c = (FrameCache){};
+}
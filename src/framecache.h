@@ -0,0 +1,61 @@
+#ifndef TEXT_ADVENTURES_FRAMECACHE
+#define TEXT_ADVENTURES_FRAMECACHE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define FRAME_CACHE_BYTES_PER_BUCKET 1024
+
+/*
+ * How a section's frame starts: at the beginning of a row, or on a
+ * row whose left border was already printed.
+ */
+enum FrameStyle {
+    FRAME_OPENS_ROW,
+    FRAME_CONTINUES_ROW,
+};
+
+/*
+ * A section rendered at one width, up to and including the prompt.
+ * Entries are shared: whoever got one from the cache holds a reference
+ * until frame_cache_release, so it stays valid even once evicted.
+ */
+typedef struct CachedFrame {
+    uint64_t version;    // Adventure.content_hash
+    uint32_t section;    // index
+    uint16_t width;
+    uint8_t style;       // enum FrameStyle
+    bool asking;         // false for endings
+    size_t col;          // column the renderer is left at
+    uint32_t refs;
+    bool evicted;
+    struct CachedFrame *newer, *older; // LRU order
+    struct CachedFrame *chain;         // next in the bucket
+    size_t len;
+    char data[];
+} CachedFrame;
+
+/*
+ * Bounded LRU of rendered frames, shared by every thread.
+ */
+typedef struct FrameCache {
+    pthread_mutex_t lock;
+    size_t bucket_count; // a power of 2
+    CachedFrame **buckets;
+    CachedFrame *newest, *oldest;
+    size_t bytes, max_bytes;
+    size_t entries;
+
+    // stats
+    size_t hits, misses, evictions;
+} FrameCache;
+
+void frame_cache_init(FrameCache *c, size_t max_bytes);
+CachedFrame *frame_cache_get(FrameCache *c, uint64_t version, uint32_t section, uint16_t width, enum FrameStyle style);
+CachedFrame *frame_cache_put(FrameCache *c, CachedFrame *rendered);
+void frame_cache_release(FrameCache *c, CachedFrame *f);
+void free_frame_cache(FrameCache *c);
+
+#endif // TEXT_ADVENTURES_FRAMECACHE
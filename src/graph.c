@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "parse.h"
+#include "graph.h"
+
+Graph adventure_graph(Adventure *adv) {
+    uint32_t const n = adv->section_count;
+    size_t edge_count = 0;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        edge_count += adv->sections[i].option_count;
+    }
+
+    Graph g = (Graph){
+        .node_count = n,
+        .start = 0,
+        .first = malloc(sizeof(uint32_t) * (n + 1)),
+        .targets = malloc(sizeof(uint32_t) * (edge_count + 1)),
+    };
+
+    if (g.first == NULL || g.targets == NULL) {
+        printf("Fatal error: can't malloc graph.");
+        exit(1);
+    }
+
+    uint32_t e = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        Section *s = &adv->sections[i];
+        Option *options = section_options(s);
+        g.first[i] = e;
+
+        for (size_t j = 0; j < s->option_count; ++j) {
+            Section *next = find_section(adv, options[j].section_id);
+            g.targets[e++] = next != NULL ? (uint32_t)(next - adv->sections) : i;
+        }
+    }
+    g.first[n] = e;
+
+    return g;
+}
+
+static void *graph_alloc(size_t size) {
+    void *p = malloc(size > 0 ? size : 1);
+
+    if (p == NULL) {
+        printf("Fatal error: can't malloc graph.");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * A node Tarjan's algorithm is looking at, and the next edge it takes.
+ */
+typedef struct TarjanFrame {
+    uint32_t node;
+    uint32_t edge;
+} TarjanFrame;
+
+/*
+ * Finds the strongly connected components of the nodes reachable from
+ * g->start (Tarjan's algorithm, without recursion so long chains don't
+ * overflow the stack). Components are numbered in reverse topological
+ * order: edges only lead to components with a smaller or equal number,
+ * so the start's comes last. Unreachable nodes get NO_COMPONENT.
+ * Returns how many components there are.
+ */
+uint32_t graph_components(Graph *g, uint32_t *component) {
+    uint32_t const n = g->node_count;
+    if (n == 0) {
+        return 0;
+    }
+
+    uint32_t *index = graph_alloc(sizeof(uint32_t) * n);
+    uint32_t *low = graph_alloc(sizeof(uint32_t) * n);
+    uint32_t *stack = graph_alloc(sizeof(uint32_t) * n);
+    TarjanFrame *frames = graph_alloc(sizeof(TarjanFrame) * n);
+
+    for (uint32_t i = 0; i < n; ++i) {
+        index[i] = NO_COMPONENT;
+        component[i] = NO_COMPONENT;
+    }
+
+    uint32_t next_index = 0, count = 0, sp = 0, fp = 0;
+    index[g->start] = low[g->start] = next_index++;
+    stack[sp++] = g->start;
+    frames[fp++] = (TarjanFrame){ .node = g->start, .edge = g->first[g->start] };
+
+    while (fp > 0) {
+        TarjanFrame *f = &frames[fp - 1];
+        uint32_t const v = f->node;
+
+        if (f->edge < g->first[v + 1]) {
+            uint32_t const w = g->targets[f->edge++];
+
+            if (index[w] == NO_COMPONENT) {
+                index[w] = low[w] = next_index++;
+                stack[sp++] = w;
+                frames[fp++] = (TarjanFrame){ .node = w, .edge = g->first[w] };
+            } else if (component[w] == NO_COMPONENT && index[w] < low[v]) {
+                low[v] = index[w]; // w is still on the stack
+            }
+            continue;
+        }
+
+        if (low[v] == index[v]) {
+            uint32_t w;
+            do {
+                w = stack[--sp];
+                component[w] = count;
+            } while (w != v);
+            count++;
+        }
+
+        fp--;
+        if (fp > 0 && low[v] < low[frames[fp - 1].node]) {
+            low[frames[fp - 1].node] = low[v];
+        }
+    }
+
+    free(index);
+    free(low);
+    free(stack);
+    free(frames);
+    return count;
+}
+
+/*
+ * Groups the nodes by the component graph_components put them in:
+ * component c's are members[first[c]] .. members[first[c + 1] - 1].
+ * first has count + 1 entries, members one per reachable node.
+ */
+void graph_component_members(Graph *g, uint32_t *component, uint32_t count, uint32_t *first, uint32_t *members) {
+    uint32_t *fill = graph_alloc(sizeof(uint32_t) * (count + 1));
+
+    memset(first, 0, sizeof(uint32_t) * (count + 1));
+    for (uint32_t v = 0; v < g->node_count; ++v) {
+        if (component[v] != NO_COMPONENT) first[component[v] + 1]++;
+    }
+    for (uint32_t c = 0; c < count; ++c) {
+        first[c + 1] += first[c];
+    }
+
+    memcpy(fill, first, sizeof(uint32_t) * (count + 1));
+    for (uint32_t v = 0; v < g->node_count; ++v) {
+        if (component[v] != NO_COMPONENT) members[fill[component[v]]++] = v;
+    }
+
+    free(fill);
+}
+
+/*
+ * The same graph with every edge turned around: the nodes with an
+ * option leading to v are targets[first[v]] .. targets[first[v + 1] - 1],
+ * once per option.
+ */
+Graph graph_reverse(Graph *g) {
+    uint32_t const n = g->node_count;
+    uint32_t const edges = g->first[n];
+    Graph r = (Graph){
+        .node_count = n,
+        .start = g->start,
+        .first = calloc(n + 1, sizeof(uint32_t)),
+        .targets = graph_alloc(sizeof(uint32_t) * edges),
+    };
+    uint32_t *fill = graph_alloc(sizeof(uint32_t) * (n + 1));
+
+    if (r.first == NULL) {
+        printf("Fatal error: can't malloc graph.");
+        exit(1);
+    }
+
+    for (uint32_t e = 0; e < edges; ++e) {
+        r.first[g->targets[e] + 1]++;
+    }
+    for (uint32_t v = 0; v < n; ++v) {
+        r.first[v + 1] += r.first[v];
+    }
+
+    memcpy(fill, r.first, sizeof(uint32_t) * (n + 1));
+    for (uint32_t u = 0; u < n; ++u) {
+        for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+            r.targets[fill[g->targets[e]]++] = u;
+        }
+    }
+
+    free(fill);
+    return r;
+}
+
+/*
+ * Collapses every chain of nodes with a single option into one node.
+ * A node joins the chain before it when that chain's last node is the
+ * only way in and has no other option; the start always begins a chain.
+ * What's left plays out the same: no choice is made inside a chain, so
+ * counts and odds don't change, and graph_steps says how many steps a
+ * node takes for path lengths.
+ */
+Graph compact_graph(Graph *g) {
+    uint32_t const n = g->node_count;
+    uint32_t *in = calloc(n + 1, sizeof(uint32_t));
+    uint32_t *from = graph_alloc(sizeof(uint32_t) * (n + 1)); // the last predecessor seen
+    bool *head = graph_alloc(sizeof(bool) * (n + 1));
+    Graph c = (Graph){
+        .original_count = n,
+        .segment_first = graph_alloc(sizeof(uint32_t) * (n + 1)),
+        .segments = graph_alloc(sizeof(uint32_t) * (n + 1)),
+        .node_of = graph_alloc(sizeof(uint32_t) * (n + 1)),
+    };
+
+    if (in == NULL) {
+        printf("Fatal error: can't malloc graph.");
+        exit(1);
+    }
+
+    for (uint32_t u = 0; u < n; ++u) {
+        for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+            in[g->targets[e]]++;
+            from[g->targets[e]] = u;
+        }
+    }
+    for (uint32_t v = 0; v < n; ++v) {
+        head[v] = v == g->start || in[v] != 1 || from[v] == v || graph_degree(g, from[v]) != 1;
+        c.node_of[v] = NO_COMPONENT;
+    }
+
+    // chains from every head, then whatever is left: loops nothing leads into
+    uint32_t count = 0, placed = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (uint32_t v = 0; v < n; ++v) {
+            if (c.node_of[v] != NO_COMPONENT || (pass == 0 && !head[v])) continue;
+
+            c.segment_first[count] = placed;
+            uint32_t u = v;
+            do {
+                c.node_of[u] = count;
+                c.segments[placed++] = u;
+                u = graph_degree(g, u) == 1 ? g->targets[g->first[u]] : u;
+            } while (!head[u] && c.node_of[u] == NO_COMPONENT);
+            count++;
+        }
+    }
+    c.segment_first[count] = placed;
+
+    c.node_count = count;
+    c.start = n > 0 ? c.node_of[g->start] : 0;
+    c.first = graph_alloc(sizeof(uint32_t) * (count + 1));
+    c.targets = graph_alloc(sizeof(uint32_t) * (g->first[n] + 1));
+
+    uint32_t e = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t const last = c.segments[c.segment_first[i + 1] - 1];
+        c.first[i] = e;
+        for (uint32_t j = g->first[last]; j < g->first[last + 1]; ++j) {
+            c.targets[e++] = c.node_of[g->targets[j]];
+        }
+    }
+    c.first[count] = e;
+
+    free(in);
+    free(from);
+    free(head);
+    return c;
+}
+
+void free_graph(Graph *g) {
+    free(g->first);
+    free(g->targets);
+    free(g->segment_first);
+    free(g->segments);
+    free(g->node_of);
+    *g = (Graph){};
+}
@@ -0,0 +1,57 @@
+#ifndef TEXT_ADVENTURES_GRAPH
+#define TEXT_ADVENTURES_GRAPH
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parse.h"
+
+/*
+ * The option graph of an adventure, for analysis: node i is section i,
+ * and its options' targets are targets[first[i]] .. targets[first[i + 1] - 1].
+ * Like in the game, a dangling option leaves the player where they were.
+ */
+typedef struct Graph {
+    uint32_t node_count;
+    uint32_t start;    // node play starts at
+    uint32_t *first;   // node_count + 1 entries
+    uint32_t *targets;
+
+    // set by compact_graph: node i plays the original nodes
+    // segments[segment_first[i]] .. segments[segment_first[i + 1] - 1]
+    // in order, and original node j is part of node node_of[j]
+    uint32_t original_count;
+    uint32_t *segment_first;
+    uint32_t *segments;
+    uint32_t *node_of;
+} Graph;
+
+#define NO_COMPONENT UINT32_MAX
+
+Graph adventure_graph(Adventure *adv);
+uint32_t graph_components(Graph *g, uint32_t *component);
+void graph_component_members(Graph *g, uint32_t *component, uint32_t count, uint32_t *first, uint32_t *members);
+Graph graph_reverse(Graph *g);
+Graph compact_graph(Graph *g);
+void free_graph(Graph *g);
+
+static inline uint32_t graph_degree(Graph *g, uint32_t node) {
+    return g->first[node + 1] - g->first[node];
+}
+
+/*
+ * Choices made inside a node before its own options come up: one per
+ * segment after the first.
+ */
+static inline uint32_t graph_steps(Graph *g, uint32_t node) {
+    return g->segments != NULL ? g->segment_first[node + 1] - g->segment_first[node] - 1 : 0;
+}
+
+/*
+ * The original node a compacted one ends on, where its options are.
+ */
+static inline uint32_t graph_last_segment(Graph *g, uint32_t node) {
+    return g->segments != NULL ? g->segments[g->segment_first[node + 1] - 1] : node;
+}
+
+#endif // TEXT_ADVENTURES_GRAPH
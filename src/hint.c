@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "parse.h"
+#include "hint.h"
+
+/*
+ * Reverse edge of the section graph:
+ * section `from` reaches the edge's target through option `option`.
+ */
+typedef struct ReverseEdge {
+    uint32_t from;
+    uint8_t option;
+} ReverseEdge;
+
+static void *hint_alloc(size_t size) {
+    void *p = malloc(size);
+
+    if (p == NULL) {
+        printf("Fatal error: can't malloc hint tables.");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * Computes, for every section, the shortest distance to an ending
+ * (a section without options) and the option that starts that path.
+ * This is a multi-source BFS over the reversed option graph,
+ * starting from every ending at once.
+ */
+void build_hints(Adventure *adv) {
+    size_t const n = adv->section_count;
+
+    adv->ending_distance = hint_alloc(sizeof(uint32_t) * n);
+    adv->hint_option = hint_alloc(sizeof(uint8_t) * n);
+
+    // reverse adjacency, CSR layout: edges of section v are
+    // edges[start[v]] .. edges[start[v + 1] - 1]
+    uint32_t *start = calloc(n + 1, sizeof(uint32_t));
+    if (start == NULL) {
+        printf("Fatal error: can't calloc hint tables.");
+        exit(1);
+    }
+
+    size_t edge_count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        Section *s = &adv->sections[i];
+
+        for (size_t j = 0; j < s->option_count; ++j) {
+            Section *next = find_section(adv, section_options(s)[j].section_id);
+            if (next == NULL) continue;
+
+            start[next - adv->sections + 1]++;
+            edge_count++;
+        }
+    }
+    for (size_t i = 0; i < n; ++i) start[i + 1] += start[i];
+
+    ReverseEdge *edges = hint_alloc(sizeof(ReverseEdge) * (edge_count + 1));
+    uint32_t *fill = hint_alloc(sizeof(uint32_t) * (n + 1));
+    memcpy(fill, start, sizeof(uint32_t) * (n + 1));
+
+    for (size_t i = 0; i < n; ++i) {
+        Section *s = &adv->sections[i];
+
+        for (size_t j = 0; j < s->option_count && j < HINT_NO_OPTION; ++j) {
+            Section *next = find_section(adv, section_options(s)[j].section_id);
+            if (next == NULL) continue;
+
+            edges[fill[next - adv->sections]++] = (ReverseEdge){
+                .from = i,
+                .option = j,
+            };
+        }
+    }
+
+    // BFS, seeded with every ending
+    uint32_t *queue = fill; // reuse, every section is queued at most once
+    size_t head = 0, tail = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        adv->hint_option[i] = HINT_NO_OPTION;
+
+        if (adv->sections[i].option_count == 0) {
+            adv->ending_distance[i] = 0;
+            queue[tail++] = i;
+        } else {
+            adv->ending_distance[i] = HINT_NO_ENDING;
+        }
+    }
+
+    while (head < tail) {
+        uint32_t v = queue[head++];
+
+        for (uint32_t e = start[v]; e < start[v + 1]; ++e) {
+            uint32_t u = edges[e].from;
+            if (adv->ending_distance[u] != HINT_NO_ENDING) continue;
+
+            adv->ending_distance[u] = adv->ending_distance[v] + 1;
+            adv->hint_option[u] = edges[e].option;
+            queue[tail++] = u;
+        }
+    }
+
+    free(start);
+    free(edges);
+    free(fill);
+}
+
+/*
+ * Returns the option (0 based) that leads to the closest ending from
+ * section s, and how many choices away that ending is.
+ * Returns false when s is an ending or no ending can be reached.
+ */
+bool adventure_hint(Adventure *adv, Section *s, size_t *option, size_t *distance) {
+    size_t const i = s - adv->sections;
+
+    if (adv->hint_option[i] == HINT_NO_OPTION) {
+        return false;
+    }
+
+    *option = adv->hint_option[i];
+    *distance = adv->ending_distance[i];
+    return true;
+}
@@ -0,0 +1,15 @@
+#ifndef TEXT_ADVENTURES_HINT
+#define TEXT_ADVENTURES_HINT
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parse.h"
+
+#define HINT_NO_ENDING UINT32_MAX // distance when no ending is reachable
+#define HINT_NO_OPTION UINT8_MAX  // option for endings and dead ends
+
+void build_hints(Adventure *adv);
+bool adventure_hint(Adventure *adv, Section *s, size_t *option, size_t *distance);
+
+#endif // TEXT_ADVENTURES_HINT
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "input.h"
+
+#define ESC 0x1b
+
+void input_init(Input *in, int fd) {
+    *in = (Input){ .fd = fd };
+}
+
+/*
+ * Moves the buffered bytes to the front, so there's room after them.
+ */
+static void compact(Input *in) {
+    if (in->start > 0) {
+        memmove(in->data, in->data + in->start, in->len);
+        in->start = 0;
+    }
+}
+
+/*
+ * Reads whatever is available on fd with a single read.
+ * Call it once poll reports fd as readable.
+ * Returns false when fd was closed or failed.
+ */
+bool input_fill(Input *in) {
+    compact(in);
+
+    if (in->len == INPUT_BUFFER_SIZE) {
+        return true; // keys have to be taken out first
+    }
+
+    ssize_t const n = read(in->fd, in->data + in->len, INPUT_BUFFER_SIZE - in->len);
+
+    if (n > 0) {
+        in->len += n;
+        return true;
+    }
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return true;
+    }
+
+    in->eof = true;
+    return false;
+}
+
+/*
+ * Appends bytes that were received some other way.
+ * Whatever doesn't fit in the buffer is dropped.
+ */
+void input_feed(Input *in, const char *bytes, size_t len) {
+    compact(in);
+
+    if (len > INPUT_BUFFER_SIZE - in->len) {
+        len = INPUT_BUFFER_SIZE - in->len;
+    }
+    memcpy(in->data + in->len, bytes, len);
+    in->len += len;
+}
+
+static enum InputResult take(Input *in, size_t size, Key *key, enum KeyType type, uint32_t cp) {
+    in->start += size;
+    in->len -= size;
+    *key = (Key){ .type = type, .cp = cp };
+    return INPUT_KEY;
+}
+
+/*
+ * Decodes ESC [ ... and ESC O ... sequences.
+ * Returns the size of the sequence, or 0 if it isn't complete yet.
+ */
+static size_t escape_sequence(unsigned char *s, size_t len, enum KeyType *type) {
+    *type = KEY_UNKNOWN;
+
+    if (len < 3) {
+        return 0;
+    }
+
+    if (s[1] == 'O') {
+        switch (s[2]) {
+            case 'A': *type = KEY_UP; break;
+            case 'B': *type = KEY_DOWN; break;
+            case 'C': *type = KEY_RIGHT; break;
+            case 'D': *type = KEY_LEFT; break;
+            case 'H': *type = KEY_HOME; break;
+            case 'F': *type = KEY_END; break;
+        }
+        return 3;
+    }
+
+    // CSI: parameter bytes, intermediate bytes, then a final byte
+    size_t i = 2;
+    unsigned param = 0;
+    while (i < len && s[i] >= 0x30 && s[i] <= 0x3f) {
+        if (s[i] >= '0' && s[i] <= '9' && param < 1000) {
+            param = param * 10 + (s[i] - '0');
+        }
+        ++i;
+    }
+    while (i < len && s[i] >= 0x20 && s[i] <= 0x2f) {
+        ++i;
+    }
+    if (i == len) {
+        return 0;
+    }
+
+    switch (s[i]) {
+        case 'A': *type = KEY_UP; break;
+        case 'B': *type = KEY_DOWN; break;
+        case 'C': *type = KEY_RIGHT; break;
+        case 'D': *type = KEY_LEFT; break;
+        case 'H': *type = KEY_HOME; break;
+        case 'F': *type = KEY_END; break;
+        case '~':
+            if (param == 1 || param == 7) *type = KEY_HOME;
+            if (param == 4 || param == 8) *type = KEY_END;
+            if (param == 3) *type = KEY_DELETE;
+            break;
+    }
+    return i + 1;
+}
+
+/*
+ * Takes the next key out of the buffer.
+ * A key whose bytes haven't all arrived yet gives INPUT_AGAIN, unless
+ * flush is set: then whatever is there is taken as it is. That's how
+ * a lone Esc is told apart from an escape sequence: by waiting
+ * INPUT_ESCAPE_TIMEOUT for the rest of it and then flushing.
+ * A key that fills the whole buffer can't ever be completed, so it's
+ * flushed right away.
+ */
+enum InputResult input_key(Input *in, Key *key, bool flush) {
+    unsigned char *s = in->data + in->start;
+    size_t const len = in->len;
+    flush |= in->eof || len == INPUT_BUFFER_SIZE;
+
+    if (len == 0) {
+        return in->eof ? INPUT_EOF : INPUT_AGAIN;
+    }
+
+    unsigned char const c = s[0];
+
+    if (c == ESC) {
+        if (len == 1) {
+            return flush ? take(in, 1, key, KEY_ESCAPE, c) : INPUT_AGAIN;
+        }
+        if (s[1] == ESC) {
+            return take(in, 1, key, KEY_ESCAPE, c);
+        }
+        if (s[1] != '[' && s[1] != 'O') {
+            // terminals send Alt with a key as ESC and that key
+            in->start++;
+            in->len--;
+            enum InputResult const result = input_key(in, key, flush);
+            if (result != INPUT_KEY) {
+                in->start--;
+                in->len++;
+                return result;
+            }
+            key->type = key->type == KEY_CHAR ? KEY_ALT : KEY_UNKNOWN;
+            return INPUT_KEY;
+        }
+
+        enum KeyType type;
+        size_t const size = escape_sequence(s, len, &type);
+        if (size == 0) {
+            return flush ? take(in, len, key, KEY_UNKNOWN, c) : INPUT_AGAIN;
+        }
+        return take(in, size, key, type, c);
+    }
+
+    if (c == '\r' || c == '\n') {
+        // \r\n, as sent by telnet-like clients, is a single enter
+        size_t const size = c == '\r' && len > 1 && s[1] == '\n' ? 2 : 1;
+        return take(in, size, key, KEY_ENTER, c);
+    }
+
+    if (c == 0x7f || c == '\b') {
+        return take(in, 1, key, KEY_BACKSPACE, c);
+    }
+
+    if (c < 0x80) {
+        return take(in, 1, key, KEY_CHAR, c);
+    }
+
+    size_t const size = c >= 0xf8 ? 0 : c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 0;
+    if (size == 0) {
+        return take(in, 1, key, KEY_UNKNOWN, c);
+    }
+
+    uint32_t cp = c & (0x7f >> size);
+    for (size_t i = 1; i < size; ++i) {
+        if (i == len) {
+            return flush ? take(in, len, key, KEY_UNKNOWN, c) : INPUT_AGAIN;
+        }
+        if ((s[i] & 0xc0) != 0x80) {
+            return take(in, i, key, KEY_UNKNOWN, c);
+        }
+        cp = cp << 6 | (s[i] & 0x3f);
+    }
+    return take(in, size, key, KEY_CHAR, cp);
+}
+
+/*
+ * Whether there are bytes left in the buffer, possibly
+ * the beginning of a key that hasn't fully arrived.
+ */
+bool input_pending(Input *in) {
+    return in->len > 0;
+}
@@ -0,0 +1,55 @@
+#ifndef TEXT_ADVENTURES_INPUT
+#define TEXT_ADVENTURES_INPUT
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define INPUT_BUFFER_SIZE 256
+#define INPUT_ESCAPE_TIMEOUT 25 // ms to wait for the rest of an escape sequence
+
+enum KeyType {
+    KEY_CHAR,       // a character, see cp
+    KEY_ALT,        // a character typed with Alt held, see cp
+    KEY_ENTER,
+    KEY_BACKSPACE,
+    KEY_ESCAPE,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_RIGHT,
+    KEY_LEFT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_UNKNOWN,    // an escape sequence or byte that means nothing to us
+};
+
+typedef struct Key {
+    enum KeyType type;
+    uint32_t cp;
+} Key;
+
+/*
+ * Raw bytes read from a terminal or a socket, waiting to be decoded.
+ * Keys typed ahead stay in the buffer until they're asked for.
+ */
+typedef struct Input {
+    int fd;
+    bool eof;
+    size_t start, len;
+    unsigned char data[INPUT_BUFFER_SIZE];
+} Input;
+
+enum InputResult {
+    INPUT_KEY,      // a key was decoded
+    INPUT_AGAIN,    // more bytes are needed, poll fd and call input_fill
+    INPUT_EOF,      // fd was closed and every key was used
+};
+
+void input_init(Input *in, int fd);
+bool input_fill(Input *in);
+void input_feed(Input *in, const char *bytes, size_t len);
+enum InputResult input_key(Input *in, Key *key, bool flush);
+bool input_pending(Input *in);
+
+#endif // TEXT_ADVENTURES_INPUT
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "parse.h"
+#include "intern.h"
+
+#define POOL_INITIAL_CAPACITY 64
+#define POOL_BLOCK_SIZE 0x10000
+
+static void *pool_alloc(size_t size) {
+    void *p = calloc(1, size);
+
+    if (p == NULL) {
+        printf("Fatal error: can't calloc string pool.");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * FNV-1a, also returns the length of s.
+ */
+static uint64_t hash_string(char *s, size_t *len) {
+    uint64_t h = 0xcbf29ce484222325;
+    char *c = s;
+
+    for (; *c; ++c) {
+        h ^= (unsigned char)*c;
+        h *= 0x100000001b3;
+    }
+    *len = c - s;
+    return h;
+}
+
+StringPool *new_string_pool() {
+    StringPool *p = pool_alloc(sizeof(StringPool));
+
+    p->capacity = POOL_INITIAL_CAPACITY;
+    p->slots = pool_alloc(sizeof(char *) * p->capacity);
+    p->hashes = pool_alloc(sizeof(uint64_t) * p->capacity);
+    return p;
+}
+
+/*
+ * Doubles the hash table once it's half full.
+ */
+static void grow(StringPool *p) {
+    size_t const capacity = p->capacity * 2;
+    char **slots = pool_alloc(sizeof(char *) * capacity);
+    uint64_t *hashes = pool_alloc(sizeof(uint64_t) * capacity);
+
+    for (size_t i = 0; i < p->capacity; ++i) {
+        if (p->slots[i] == NULL) continue;
+
+        size_t j = p->hashes[i] & (capacity - 1);
+        while (slots[j] != NULL) j = (j + 1) & (capacity - 1);
+
+        slots[j] = p->slots[i];
+        hashes[j] = p->hashes[i];
+    }
+
+    free(p->slots);
+    free(p->hashes);
+    p->slots = slots;
+    p->hashes = hashes;
+    p->capacity = capacity;
+}
+
+/*
+ * Copies a string into the pool's blocks, so unique strings are
+ * packed together instead of living in their own allocations.
+ */
+static char *store(StringPool *p, char *s, size_t size) {
+    StringBlock *b = p->blocks;
+
+    if (b == NULL || b->size - b->used < size) {
+        size_t const block_size = size > POOL_BLOCK_SIZE ? size : POOL_BLOCK_SIZE;
+
+        b = pool_alloc(sizeof(StringBlock) + block_size);
+        b->size = block_size;
+        b->next = p->blocks;
+        p->blocks = b;
+    }
+
+    char *out = b->chars + b->used;
+    memcpy(out, s, size);
+    b->used += size;
+    return out;
+}
+
+/*
+ * Returns the pool's copy of s, adding it if it's new.
+ * s is freed either way: the pool owns its strings.
+ */
+char *intern_string(StringPool *p, char *s) {
+    size_t len;
+    uint64_t const h = hash_string(s, &len);
+    size_t i = h & (p->capacity - 1);
+
+    p->strings++;
+
+    while (p->slots[i] != NULL) {
+        if (p->hashes[i] == h && strcmp(p->slots[i], s) == 0) {
+            p->saved_bytes += len + 1;
+            free(s);
+            return p->slots[i];
+        }
+        i = (i + 1) & (p->capacity - 1);
+    }
+
+    char *out = store(p, s, len + 1);
+    free(s);
+
+    p->slots[i] = out;
+    p->hashes[i] = h;
+    p->unique++;
+    p->bytes += len + 1;
+
+    if (p->unique * 2 > p->capacity) {
+        grow(p);
+    }
+
+    return out;
+}
+
+/*
+ * Interns the text of some sections and of their options.
+ */
+void intern_sections(StringPool *p, Section *sections, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        Section *s = &sections[i];
+        Option *options = section_options(s);
+
+        s->text = intern_string(p, s->text);
+        for (size_t j = 0; j < s->option_count; ++j) {
+            options[j].text = intern_string(p, options[j].text);
+        }
+    }
+}
+
+void free_string_pool(StringPool *p) {
+    if (p == NULL) return;
+
+    while (p->blocks != NULL) {
+        StringBlock *next = p->blocks->next;
+        free(p->blocks);
+        p->blocks = next;
+    }
+
+    free(p->slots);
+    free(p->hashes);
+    free(p);
+}
@@ -0,0 +1,33 @@
+#ifndef TEXT_ADVENTURES_INTERN
+#define TEXT_ADVENTURES_INTERN
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Section;
+
+typedef struct StringBlock {
+    struct StringBlock *next;
+    size_t used, size;
+    char chars[];
+} StringBlock;
+
+typedef struct StringPool {
+    size_t capacity;  // hash table slots, a power of 2
+    char **slots;
+    uint64_t *hashes;
+    StringBlock *blocks;
+
+    // stats
+    size_t strings;     // interned so far
+    size_t unique;      // distinct strings kept
+    size_t bytes;       // bytes kept, null chars included
+    size_t saved_bytes; // bytes of the duplicates that were dropped
+} StringPool;
+
+StringPool *new_string_pool();
+char *intern_string(StringPool *p, char *s);
+void intern_sections(StringPool *p, struct Section *sections, size_t count);
+void free_string_pool(StringPool *p);
+
+#endif // TEXT_ADVENTURES_INTERN
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "width.h"
+#include "parse.h"
+#include "compress.h"
+#include "adventure.h"
+#include "layout.h"
+
+static void *layout_alloc(size_t size) {
+    void *p = calloc(1, size);
+
+    if (p == NULL) {
+        printf("Fatal error: can't calloc layout.");
+        exit(1);
+    }
+    return p;
+}
+
+#define ONES  0x0101010101010101ull
+#define HIGHS 0x8080808080808080ull
+
+/*
+ * Length of the run of printable ASCII at the start of s, up to len bytes.
+ * Eight bytes are checked at a time: a byte stops the run if it has
+ * the high bit set or is below '!' (whitespace, controls, the terminator).
+ */
+static size_t ascii_run(const char *s, size_t len) {
+    size_t n = 0;
+
+    while (n + 8 <= len) {
+        uint64_t x;
+        memcpy(&x, s + n, 8);
+
+        if (((x - ONES * '!') | x) & HIGHS) {
+            break;
+        }
+        n += 8;
+    }
+
+    while (n < len && s[n] > ' ' && (unsigned char)s[n] < 0x80) {
+        ++n;
+    }
+    return n;
+}
+
+static void push_line(Layout *l, size_t *capacity, Line line) {
+    if (l->line_count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 4;
+        Line *p = realloc(l->lines, sizeof(Line) * *capacity);
+
+        if (p == NULL) {
+            printf("Fatal error: can't realloc layout.");
+            exit(1);
+        }
+        l->lines = p;
+    }
+
+    l->lines[l->line_count++] = line;
+}
+
+/*
+ * Ends the current line and starts the next one at byte pos.
+ */
+static void break_line(Layout *out, size_t *capacity, Line *line, size_t pos,
+                       size_t *col, size_t *start_col, size_t line_col) {
+    line->width = *col - *start_col;
+    push_line(out, capacity, *line);
+    *line = (Line){ .begin = pos, .end = pos, .verbatim = true };
+    *col = *start_col = line_col;
+}
+
+/*
+ * Splits text in lines, fitting full words when possible.
+ * The first line starts at first_col, the rest at line_col;
+ * words have to end before max_col. Words too long for a line
+ * of their own are broken wherever the line is full.
+ * Columns are counted by display width and grapheme clusters
+ * are never split. The text is scanned once and lines are byte spans into it.
+ */
+Layout layout_text(char *text, size_t first_col, size_t line_col, size_t max_col) {
+    Layout out = (Layout){ .line_count = 0, .lines = NULL };
+    size_t capacity = 0;
+
+    // widest word that fits on a line of its own
+    size_t const room = max_col > line_col + 1 ? max_col - line_col - 1 : 1;
+
+    width_init();
+
+    size_t const len = strlen(text);
+    size_t pos = 0;
+    size_t col = first_col, start_col = first_col;
+    Line line = (Line){ .begin = 0, .end = 0, .verbatim = true };
+
+    while (text[pos]) {
+        size_t word_end = pos, word_len = 0;
+        while (text[word_end]) {
+            size_t const run = ascii_run(text + word_end, len - word_end);
+            word_end += run;
+            word_len += run;
+
+            if (text[word_end] == 0 || char_is_blank(text + word_end)) {
+                break;
+            }
+
+            size_t width;
+            word_end += next_grapheme(text + word_end, &width);
+            word_len += width;
+        }
+
+        if (col + word_len >= max_col && word_len <= room) {
+            break_line(&out, &capacity, &line, pos, &col, &start_col, line_col);
+        }
+
+        // too long for any line: fill lines up, one grapheme at a time
+        while (col + word_len >= max_col) {
+            size_t const fill = col + 1 < max_col ? max_col - 1 - col : 0;
+            size_t taken = 0, width;
+
+            while (true) {
+                size_t const size = next_grapheme(text + pos, &width);
+                if (taken + width > fill && (taken > 0 || line.end > line.begin)) break;
+                pos += size;
+                taken += width;
+            }
+
+            line.end = pos;
+            col += taken;
+            word_len -= taken;
+            break_line(&out, &capacity, &line, pos, &col, &start_col, line_col);
+        }
+
+        line.end = word_end;
+        col += word_len;
+        pos = word_end;
+
+        if (text[pos] == 0) {
+            break;
+        }
+
+        size_t const delimiter_size = char_size(text + pos);
+
+        if (col + 1 < max_col) {
+            if (text[pos] == '\n') {
+                break_line(&out, &capacity, &line, pos + 1, &col, &start_col, line_col);
+            } else {
+                line.end += delimiter_size;
+                line.verbatim &= text[pos] == ' ';
+                col++;
+            }
+        }
+
+        pos += delimiter_size;
+    }
+
+    line.width = col - start_col;
+    push_line(&out, &capacity, line);
+    return out;
+}
+
+void free_layout(Layout *l) {
+    free(l->lines);
+    *l = (Layout){};
+}
+
+void layout_cache_init(LayoutCache *c, size_t section_count) {
+    *c = (LayoutCache){
+        .section_count = section_count,
+        .entries = layout_alloc(sizeof(SectionLayout *) * section_count),
+    };
+}
+
+static void free_entry(SectionLayout *e) {
+    if (e->width == 0) return;
+
+    free_layout(&e->text);
+    for (size_t i = 0; i < e->option_count; ++i) {
+        free_layout(&e->options[i]);
+    }
+    free(e->options);
+    *e = (SectionLayout){};
+}
+
+/*
+ * Returns the section's text and options wrapped for a terminal width,
+ * wrapping them only if that wasn't done before.
+ * Each section keeps the last LAYOUT_CACHE_WIDTHS widths it was shown in.
+ */
+SectionLayout *layout_section(LayoutCache *c, Adventure *adv, Section *s, uint16_t width) {
+    SectionLayout **slot = &c->entries[s - adv->sections];
+    if (*slot == NULL) {
+        *slot = layout_alloc(sizeof(SectionLayout) * LAYOUT_CACHE_WIDTHS);
+    }
+
+    SectionLayout *entries = *slot;
+    SectionLayout *victim = &entries[0];
+    c->clock++;
+
+    for (size_t i = 0; i < LAYOUT_CACHE_WIDTHS; ++i) {
+        if (entries[i].width == width) {
+            entries[i].last_used = c->clock;
+            c->hits++;
+            return &entries[i];
+        }
+
+        if (entries[i].last_used < victim->last_used) {
+            victim = &entries[i];
+        }
+    }
+
+    c->misses++;
+    free_entry(victim);
+
+    size_t const line_col = L_PADDING + 1;
+    size_t const max_col = width - R_PADDING - 1;
+    Option *options = section_options(s);
+
+    victim->width = width;
+    victim->last_used = c->clock;
+    victim->text = layout_text(section_text(adv, s), line_col, line_col, max_col);
+    victim->option_count = s->option_count;
+    victim->options = layout_alloc(sizeof(Layout) * (s->option_count + 1));
+
+    for (size_t i = 0; i < s->option_count; ++i) {
+        char prefix[24];
+        size_t const prefix_len = sprintf(prefix, "%zu) ", i + 1);
+        victim->options[i] = layout_text(options[i].text, line_col + prefix_len, line_col, max_col);
+    }
+
+    return victim;
+}
+
+/*
+ * Drops every cached layout, e.g. after the terminal was resized.
+ */
+void layout_cache_clear(LayoutCache *c) {
+    for (size_t i = 0; i < c->section_count; ++i) {
+        if (c->entries[i] == NULL) continue;
+
+        for (size_t j = 0; j < LAYOUT_CACHE_WIDTHS; ++j) {
+            free_entry(&c->entries[i][j]);
+        }
+        free(c->entries[i]);
+        c->entries[i] = NULL;
+    }
+}
+
+void free_layout_cache(LayoutCache *c) {
+    layout_cache_clear(c);
+    free(c->entries);
+    *c = (LayoutCache){};
+}
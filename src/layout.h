@@ -0,0 +1,52 @@
+#ifndef TEXT_ADVENTURES_LAYOUT
+#define TEXT_ADVENTURES_LAYOUT
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parse.h"
+
+#define LAYOUT_CACHE_WIDTHS 4 // terminal widths cached per section
+
+/*
+ * A wrapped line: bytes [begin, end) of the text, taking width columns.
+ * Whitespace between words is shown as a space; verbatim is set when
+ * the bytes can be copied as they are.
+ */
+typedef struct Line {
+    uint32_t begin, end;
+    uint16_t width;
+    bool verbatim;
+} Line;
+
+typedef struct Layout {
+    size_t line_count;
+    Line *lines;
+} Layout;
+
+typedef struct SectionLayout {
+    uint16_t width; // terminal width, 0 when the entry is empty
+    uint32_t last_used;
+    Layout text;
+    size_t option_count;
+    Layout *options;
+} SectionLayout;
+
+typedef struct LayoutCache {
+    size_t section_count;
+    SectionLayout **entries; // per section: LAYOUT_CACHE_WIDTHS of them, once it's shown
+    uint32_t clock;
+
+    // stats
+    size_t hits, misses;
+} LayoutCache;
+
+Layout layout_text(char *text, size_t first_col, size_t line_col, size_t max_col);
+void free_layout(Layout *l);
+
+void layout_cache_init(LayoutCache *c, size_t section_count);
+SectionLayout *layout_section(LayoutCache *c, Adventure *adv, Section *s, uint16_t width);
+void layout_cache_clear(LayoutCache *c);
+void free_layout_cache(LayoutCache *c);
+
+#endif // TEXT_ADVENTURES_LAYOUT
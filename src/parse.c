@@ -6,7 +6,12 @@
 
 #include "utf8.h"
 #include "parse.h"
+#include "hint.h"
+#include "compress.h"
 
+enum ParseStateEnum parse_state;
+enum ParseErrorEnum parse_error;
+size_t p_col, p_row, p_prev_col;
 
 static utf8char get_char(FILE *stream);
 static void return_char(FILE *stream, utf8char c);
@@ -254,7 +259,8 @@ static Object create_object(FILE *stream) {
     utf8char c;
     Object out = (Object){
         .relation_count = 0,
-        .relations = malloc(sizeof(Relation *))
+        .relations = malloc(sizeof(Relation *)),
+        .begin = ftell(stream) - 1, // { was already read
     };
     bool allow_comma = false;
 
@@ -277,6 +283,7 @@ static Object create_object(FILE *stream) {
             allow_comma = true;
 
         } else if (utf8cmp(c.chr, "}") == 0) {
+            out.end = ftell(stream);
             break;
 
         } else if (utf8cmp(c.chr, ",") == 0) {
@@ -474,19 +481,15 @@ static List *create_list(FILE *stream) {
 
 /*
  * Creates Options out of a JSON-parsed List.
+ * Options are written to out, which must fit all of them.
  */
-static Option *json_to_option(List *options) {
-    if (options->object_count == 0) {
-        parse_state = PS_OK;
-        return NULL;
-
-    } else if (options->object_count > MAX_OPTION_COUNT) {
+static void json_to_option(List *options, Option *out) {
+    if (options->object_count > MAX_OPTION_COUNT) {
         parse_state = PS_ERROR;
         parse_error = PE_TOO_MANY_OPTIONS;
-        return NULL;
+        return;
     }
 
-    Option *out = malloc(sizeof(Option) * options->object_count);
     Object *opt;
     char *key;
     bool set_id;
@@ -502,8 +505,7 @@ static Option *json_to_option(List *options) {
         if (opt->relation_count != 2) {
             parse_state = PS_ERROR;
             parse_error = PE_MISSING_KEY;
-            free(out);
-            return NULL;
+            return;
         }
 
         for (size_t j = 0; j < opt->relation_count; ++j) {
@@ -513,8 +515,7 @@ static Option *json_to_option(List *options) {
                 if (o.text != NULL) {
                     parse_state = PS_ERROR;
                     parse_error = PE_REPEATED_KEY;
-                    free(out);
-                    return NULL;
+                    return;
                 }
 
                 o.text = opt->relations[j].value.str.chars;
@@ -523,8 +524,7 @@ static Option *json_to_option(List *options) {
                 if (set_id) {
                     parse_state = PS_ERROR;
                     parse_error = PE_REPEATED_KEY;
-                    free(out);
-                    return NULL;
+                    return;
                 }
 
                 o.section_id = opt->relations[j].value.num;
@@ -533,8 +533,7 @@ static Option *json_to_option(List *options) {
             } else {
                 parse_state = PS_ERROR;
                 parse_error = PE_INVALID_KEY;
-                free(out);
-                return NULL;
+                return;
             }
         }
 
@@ -542,13 +541,38 @@ static Option *json_to_option(List *options) {
     }
 
     parse_state = PS_OK;
-    return out;
+}
+
+/*
+ * Counts the options that don't fit inline in their section,
+ * so the option pool can be allocated in one go.
+ */
+static size_t count_spilled_options(List *sections) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < sections->object_count; ++i) {
+        Object *sec = &sections->elements[i];
+
+        for (size_t j = 0; j < sec->relation_count; ++j) {
+            Relation *r = &sec->relations[j];
+
+            if (r->value_type == VALUE_LIST &&
+                utf8cmp("options", r->key.chars) == 0 &&
+                r->value.list->object_count > SECTION_INLINE_OPTIONS
+            ) {
+                count += r->value.list->object_count;
+            }
+        }
+    }
+
+    return count;
 }
 
 /*
  * Creates Sections out of a JSON-parsed List.
+ * Options that don't fit inline are stored in *pool.
  */
-static Section *json_to_section(List *sections) {
+Section *json_to_section(List *sections, Option **pool, size_t *pool_size) {
     if (sections->object_count == 0) {
         parse_state = PS_ERROR;
         parse_error = PE_NO_SECTIONS;
@@ -558,22 +582,37 @@ static Section *json_to_section(List *sections) {
     Section *out = malloc(sizeof(Section) * sections->object_count);
     char *key;
     Object *sec;
-    bool set_id;
+    bool set_id, set_options;
+
+    *pool_size = count_spilled_options(sections);
+    *pool = NULL;
+    Option *pool_end = NULL;
+
+    if (*pool_size > 0) {
+        *pool = malloc(sizeof(Option) * *pool_size);
+
+        if (*pool == NULL) {
+            printf("Fatal error: can't malloc option pool.");
+            exit(1);
+        }
+        pool_end = *pool;
+    }
 
     for (size_t i = 0; i < sections->object_count; ++i) {
         sec = &sections->elements[i];
         set_id = false;
+        set_options = false;
         Section s = (Section){
             .text = NULL,
             .id = 0,
             .option_count = 0,
-            .options = NULL,
         };
 
         if (sec->relation_count != 3) {
             parse_state = PS_ERROR;
             parse_error = PE_MISSING_KEY;
             free(out);
+            free(*pool);
             return NULL;
         }
 
@@ -585,6 +624,7 @@ static Section *json_to_section(List *sections) {
                     parse_state = PS_ERROR;
                     parse_error = PE_REPEATED_KEY;
                     free(out);
+                    free(*pool);
                     return NULL;
                 }
 
@@ -595,6 +635,7 @@ static Section *json_to_section(List *sections) {
                     parse_state = PS_ERROR;
                     parse_error = PE_REPEATED_KEY;
                     free(out);
+                    free(*pool);
                     return NULL;
                 }
 
@@ -602,27 +643,37 @@ static Section *json_to_section(List *sections) {
                 set_id = true;
 
             } else if (utf8cmp("options", key) == 0) {
-                if (s.options != NULL) {
+                if (set_options) {
                     parse_state = PS_ERROR;
                     parse_error = PE_REPEATED_KEY;
                     free(out);
+                    free(*pool);
                     return NULL;
                 }
 
-                Option *opt = json_to_option(sec->relations[j].value.list);
+                List *options = sec->relations[j].value.list;
+                s.option_count = options->object_count;
+
+                if (s.option_count > SECTION_INLINE_OPTIONS) {
+                    s.spilled_options = pool_end;
+                    pool_end += s.option_count;
+                }
+
+                json_to_option(options, section_options(&s));
                 if (parse_state != PS_OK) {
                     free(out);
+                    free(*pool);
                     return NULL;
                 }
 
-                s.option_count = sec->relations[j].value.list->object_count;
-                s.options = opt;
-                free(sec->relations[j].value.list->elements);
+                set_options = true;
+                free(options->elements);
 
             } else {
                 parse_state = PS_ERROR;
                 parse_error = PE_INVALID_KEY;
                 free(out);
+                free(*pool);
                 return NULL;
             }
         }
@@ -689,7 +740,11 @@ Adventure json_to_adventure(Object adventure) {
                 return out;
             }
 
-            Section *s = json_to_section(adventure.relations[i].value.list);
+            Section *s = json_to_section(
+                adventure.relations[i].value.list,
+                &out.option_pool,
+                &out.option_pool_size
+            );
             if (parse_state != PS_OK) {
                 return out;
             }
@@ -705,6 +760,187 @@ Adventure json_to_adventure(Object adventure) {
         }
     }
 
+    out.strings = new_string_pool();
+    intern_sections(out.strings, out.sections, out.section_count);
+
+    index_sections(&out);
+    hash_sections(&out);
+    build_hints(&out);
+
     parse_state = PS_OK;
     return out;
 }
+
+/*
+ * Builds the id -> section index table.
+ * If two sections share an id, the first one wins.
+ */
+void index_sections(Adventure *adv) {
+    size_t max_id = 0;
+    for (size_t i = 0; i < adv->section_count; ++i) {
+        if (adv->sections[i].id > max_id) max_id = adv->sections[i].id;
+    }
+
+    adv->id_index_size = max_id + 1;
+    adv->id_index = malloc(sizeof(uint32_t) * adv->id_index_size);
+
+    if (adv->id_index == NULL) {
+        printf("Fatal error: can't malloc section index.");
+        exit(1);
+    }
+
+    memset(adv->id_index, 0xFF, sizeof(uint32_t) * adv->id_index_size);
+    for (size_t i = adv->section_count; i-- > 0;) {
+        adv->id_index[adv->sections[i].id] = i;
+    }
+}
+
+static uint64_t fnv_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+static uint64_t hash_section(Section *s) {
+    Option *options = section_options(s);
+    uint64_t const header[2] = { s->id, s->option_count };
+    uint64_t h = 0xcbf29ce484222325;
+
+    h = fnv_bytes(h, header, sizeof(header));
+    h = fnv_bytes(h, s->text, strlen(s->text) + 1);
+
+    for (size_t j = 0; j < s->option_count; ++j) {
+        uint64_t const id = options[j].section_id;
+        h = fnv_bytes(h, &id, sizeof(id));
+        h = fnv_bytes(h, options[j].text, strlen(options[j].text) + 1);
+    }
+    return h;
+}
+
+/*
+ * Mixes the hashes of two sections next to each other.
+ */
+static uint64_t hash_pair(uint64_t a, uint64_t b) {
+    uint64_t h = a * 0x9e3779b97f4a7c15 ^ b;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    return h ^ h >> 33;
+}
+
+/*
+ * What count sections starting at run add to content_hash, with the
+ * sections before and after them (NULL at either end of the adventure).
+ * content_hash adds up every pair of sections next to each other, so
+ * replacing a run of sections only changes the pairs it's in.
+ */
+uint64_t hash_section_run(Section *before, Section *run, size_t count, Section *after) {
+    uint64_t prev = before != NULL ? hash_section(before) : 0xcbf29ce484222325;
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t const h = hash_section(&run[i]);
+        sum += hash_pair(prev, h);
+        prev = h;
+    }
+    if (after != NULL) {
+        sum += hash_pair(prev, hash_section(after));
+    }
+    return sum;
+}
+
+/*
+ * Hashes what a saved game depends on: the sections in order,
+ * with their ids, text and options. Titles and versions can change
+ * without breaking saves. Text has to be plain, so this runs
+ * before compress_adventure.
+ */
+void hash_sections(Adventure *adv) {
+    adv->content_hash = hash_section_run(NULL, adv->sections, adv->section_count, NULL);
+}
+
+/*
+ * Looks up a section by its id.
+ * Returns NULL if there's no such section.
+ */
+Section *find_section(Adventure *adv, size_t id) {
+    if (id >= adv->id_index_size || adv->id_index[id] == NO_SECTION) {
+        return NULL;
+    }
+
+    return &adv->sections[adv->id_index[id]];
+}
+
+/*
+ * Frees everything json_to_adventure allocated for adv.
+ */
+void free_adventure(Adventure *adv) {
+    free(adv->title);
+    free(adv->author);
+    free(adv->version);
+    free(adv->sections);
+    free(adv->option_pool);
+    free_string_pool(adv->strings);
+    free_text_codec(adv->codec);
+    free(adv->id_index);
+    free(adv->ending_distance);
+    free(adv->hint_option);
+    *adv = (Adventure){};
+}
+
+/*
+ * Prints why the last parse failed.
+ */
+void show_parse_error() {
+    static char *const reasons[] = {
+        [PE_EMPTY_FILE] = "the file is empty",
+        [PE_INVALID_CHAR] = "unexpected character",
+        [PE_MISSING_VALUE] = "missing value",
+        [PE_NUMBER_TOO_BIG] = "number too big",
+        [PE_MISSING_BRACKET] = "missing bracket",
+        [PE_MISSING_DOUBLE_QUOTES] = "missing double quotes",
+        [PE_REPEATED_KEY] = "repeated key",
+        [PE_INVALID_KEY] = "invalid key",
+        [PE_MISSING_KEY] = "missing key",
+        [PE_NO_SECTIONS] = "no sections",
+        [PE_TOO_MANY_OPTIONS] = "too many options",
+    };
+
+    if (parse_error < PE_REPEATED_KEY) {
+        printf("Parse error at line %zu, column %zu: %s!\n", p_row + 1, p_col, reasons[parse_error]);
+    } else {
+        printf("Invalid adventure: %s!\n", reasons[parse_error]);
+    }
+}
+
+/*
+ * Parses an adventure file.
+ * Prints what's wrong if it's missing or can't be parsed.
+ */
+bool load_adventure_file(char *filename, Adventure *adv) {
+    FILE *f = fopen(filename, "r");
+
+    if (f == NULL) {
+        printf("File not found!\n");
+        return false;
+    }
+
+    Object json = json_parse(f);
+    fclose(f);
+
+    // converting a broken object would report a missing key instead
+    if (parse_state == PS_OK) {
+        *adv = json_to_adventure(json);
+    }
+
+    if (parse_state != PS_OK) {
+        show_parse_error();
+        return false;
+    }
+    return true;
+}
@@ -5,8 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "utf8.h"
+#include "intern.h"
 
 typedef struct utf8char {
     char *chr;
@@ -41,6 +43,7 @@ typedef struct Relation {
 typedef struct Object {
     size_t relation_count;
     Relation *relations;
+    size_t begin, end; // byte range in the stream, from { to past }
 } Object;
 
 typedef struct ObjectList {
@@ -50,18 +53,25 @@ typedef struct ObjectList {
 
 // --------------------------------------------------------
 
-typedef struct Section {
-    char *text;
-    size_t id;
-    size_t option_count;
-    struct Option *options;
-} Section;
+// sections with up to this many options keep them inline,
+// bigger ones spill to the adventure's option pool
+#define SECTION_INLINE_OPTIONS 4
 
 typedef struct Option {
     char *text;
     size_t section_id;
 } Option;
 
+typedef struct Section {
+    char *text;
+    size_t id;
+    size_t option_count;
+    union {
+        Option inline_options[SECTION_INLINE_OPTIONS];
+        Option *spilled_options; // points into Adventure.option_pool
+    };
+} Section;
+
 typedef struct Adventure {
     char *title;
     char *author;
@@ -69,14 +79,35 @@ typedef struct Adventure {
     size_t section_count;
     struct Section *current_section;
     struct Section *sections;
+
+    // owns the text of every section and option
+    StringPool *strings;
+
+    // set when section text is compressed (see compress.h)
+    struct TextCodec *codec;
+
+    // options of every section with more than SECTION_INLINE_OPTIONS
+    size_t option_pool_size;
+    Option *option_pool;
+
+    // section index by id, NO_SECTION where there's no such section
+    size_t id_index_size;
+    uint32_t *id_index;
+
+    // precomputed hints, one entry per section (see hint.h)
+    uint32_t *ending_distance;
+    uint8_t *hint_option;
+
+    // FNV-1a of every section's id, text and options (see save.h)
+    uint64_t content_hash;
 } Adventure;
 
 // --------------------------------------------------------
 
-#define MAX_SECTION_TEXT_CHAR_LIMIT 300
 #define MAX_OPTION_TEXT_CHAR_LIMIT 80
-#define MAX_OPTION_COUNT 5
+#define MAX_OPTION_COUNT 254 // option indices have to fit in a byte (see hint.h)
 #define MAX_NUMERIC_VALUE 0x186A0 // 100,000 decimal
+#define NO_SECTION UINT32_MAX
 
 
 enum ParseStateEnum {
@@ -104,13 +135,28 @@ enum ParseErrorEnum {
 
 // --------------------------------------------------------
 // parse flags, set by json_parse
-enum ParseStateEnum parse_state;
-enum ParseErrorEnum parse_error;
-size_t p_col, p_row, p_prev_col;
+extern enum ParseStateEnum parse_state;
+extern enum ParseErrorEnum parse_error;
+extern size_t p_col, p_row, p_prev_col;
 
 // --------------------------------------------------------
 
 Object json_parse(FILE *stream);
 Adventure json_to_adventure(Object adventure);
+bool load_adventure_file(char *filename, Adventure *adv);
+void show_parse_error();
+Section *json_to_section(List *sections, Option **pool, size_t *pool_size);
+void index_sections(Adventure *adv);
+void hash_sections(Adventure *adv);
+uint64_t hash_section_run(Section *before, Section *run, size_t count, Section *after);
+Section *find_section(Adventure *adv, size_t id);
+void free_adventure(Adventure *adv);
+
+/*
+ * Returns the section's options, wherever they are stored.
+ */
+static inline Option *section_options(Section *s) {
+    return s->option_count > SECTION_INLINE_OPTIONS ? s->spilled_options : s->inline_options;
+}
 
 #endif // TEXT_ADVENTURES_PARSE
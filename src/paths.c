@@ -0,0 +1,592 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "parse.h"
+#include "graph.h"
+#include "rng.h"
+#include "paths.h"
+
+static void *paths_alloc(size_t n, size_t size) {
+    void *p = calloc(n > 0 ? n : 1, size);
+
+    if (p == NULL) {
+        printf("Fatal error: can't calloc paths.");
+        exit(1);
+    }
+    return p;
+}
+
+static void count_reserve(PathCount *c, uint32_t len) {
+    if (len <= c->capacity) {
+        return;
+    }
+
+    uint32_t capacity = c->capacity > 0 ? c->capacity : 2;
+    while (capacity < len) capacity *= 2;
+
+    uint32_t *limbs = realloc(c->limbs, sizeof(uint32_t) * capacity);
+    if (limbs == NULL) {
+        printf("Fatal error: can't realloc path count.");
+        exit(1);
+    }
+    c->limbs = limbs;
+    c->capacity = capacity;
+}
+
+static void count_trim(PathCount *c) {
+    while (c->len > 0 && c->limbs[c->len - 1] == 0) c->len--;
+}
+
+static void count_set_one(PathCount *c) {
+    count_reserve(c, 1);
+    c->limbs[0] = 1;
+    c->len = 1;
+}
+
+static void count_add(PathCount *to, PathCount *from) {
+    uint32_t const len = to->len > from->len ? to->len : from->len;
+    uint64_t carry = 0;
+
+    count_reserve(to, len + 1);
+    for (uint32_t i = 0; i < len; ++i) {
+        carry += (uint64_t)(i < to->len ? to->limbs[i] : 0) + (i < from->len ? from->limbs[i] : 0);
+        to->limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+
+    to->len = len;
+    if (carry > 0) to->limbs[to->len++] = (uint32_t)carry;
+}
+
+/*
+ * to -= from, where from is no bigger than to.
+ */
+static void count_sub(PathCount *to, PathCount *from) {
+    int64_t borrow = 0;
+
+    for (uint32_t i = 0; i < to->len; ++i) {
+        int64_t d = (int64_t)to->limbs[i] - (i < from->len ? from->limbs[i] : 0) - borrow;
+        borrow = d < 0;
+        to->limbs[i] = (uint32_t)(d + (borrow << 32));
+    }
+    count_trim(to);
+}
+
+static int count_compare(PathCount *a, PathCount *b) {
+    if (a->len != b->len) {
+        return a->len < b->len ? -1 : 1;
+    }
+    for (uint32_t i = a->len; i-- > 0;) {
+        if (a->limbs[i] != b->limbs[i]) return a->limbs[i] < b->limbs[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ * Picks a number below bound uniformly, drawing as many bits as bound
+ * has until one fits.
+ */
+static void count_random(PathCount *c, PathCount *bound, Rng *rng) {
+    uint32_t const top = bound->limbs[bound->len - 1];
+    uint32_t const mask = UINT32_MAX >> __builtin_clz(top);
+
+    count_reserve(c, bound->len);
+    do {
+        for (uint32_t i = 0; i < bound->len; ++i) {
+            c->limbs[i] = (uint32_t)(rng_next(rng) >> 32);
+        }
+        c->limbs[bound->len - 1] &= mask;
+        c->len = bound->len;
+        count_trim(c);
+    } while (count_compare(c, bound) >= 0);
+}
+
+static void free_count(PathCount *c) {
+    free(c->limbs);
+    *c = (PathCount){};
+}
+
+/*
+ * The count in decimal, allocated.
+ */
+char *path_count_string(PathCount *c) {
+    // nine digits per 29.9 bits, and room for the last chunk
+    size_t const size = (size_t)c->len * 10 + 10;
+    char *s = paths_alloc(size, 1);
+    uint32_t *chunks = paths_alloc((size_t)c->len * 2 + 1, sizeof(uint32_t)); // base 10^9, lowest first
+    uint32_t *limbs = paths_alloc(c->len, sizeof(uint32_t));
+    uint32_t len = c->len, n = 0;
+
+    memcpy(limbs, c->limbs, sizeof(uint32_t) * c->len);
+    while (len > 0) {
+        uint64_t rest = 0;
+        for (uint32_t i = len; i-- > 0;) {
+            uint64_t const cur = rest << 32 | limbs[i];
+            limbs[i] = (uint32_t)(cur / 1000000000);
+            rest = cur % 1000000000;
+        }
+        chunks[n++] = (uint32_t)rest;
+        while (len > 0 && limbs[len - 1] == 0) len--;
+    }
+
+    size_t at = snprintf(s, size, "%u", n > 0 ? chunks[n - 1] : 0);
+    for (uint32_t i = n > 0 ? n - 1 : 0; i-- > 0;) {
+        at += snprintf(s + at, size - at, "%09u", chunks[i]);
+    }
+
+    free(chunks);
+    free(limbs);
+    return s;
+}
+
+/*
+ * Whether the component holds a loop: more than one node, or a node
+ * with an option back to itself.
+ */
+static bool component_cyclic(Graph *g, uint32_t *nodes, uint32_t size) {
+    if (size > 1) {
+        return true;
+    }
+    for (uint32_t e = g->first[nodes[0]]; e < g->first[nodes[0] + 1]; ++e) {
+        if (g->targets[e] == nodes[0]) return true;
+    }
+    return false;
+}
+
+/*
+ * Counts the playthroughs reaching each node, going through the
+ * components in topological order so every node's count is complete
+ * before it's passed on. Anything past a loop can be reached in
+ * infinitely many ways. Only the endings' counts are kept.
+ */
+PathCounts count_paths(Graph *g) {
+    uint32_t const n = g->node_count;
+    PathCounts counts = (PathCounts){
+        .node_count = n,
+        .endings = paths_alloc(n, sizeof(PathCount)),
+        .endless = paths_alloc(n, sizeof(bool)),
+    };
+
+    if (n == 0) {
+        return counts;
+    }
+
+    uint32_t *component = paths_alloc(n, sizeof(uint32_t));
+    uint32_t const count = graph_components(g, component);
+    uint32_t *first = paths_alloc(count + 1, sizeof(uint32_t));
+    uint32_t *members = paths_alloc(n, sizeof(uint32_t));
+    PathCount *reached = paths_alloc(n, sizeof(PathCount));
+
+    graph_component_members(g, component, count, first, members);
+    count_set_one(&reached[g->start]);
+
+    for (uint32_t c = count; c-- > 0;) {
+        uint32_t *nodes = members + first[c];
+        uint32_t const size = first[c + 1] - first[c];
+        bool const cyclic = component_cyclic(g, nodes, size);
+
+        for (uint32_t i = 0; i < size; ++i) {
+            uint32_t const u = nodes[i];
+            if (cyclic) counts.endless[u] = true;
+
+            for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+                uint32_t const t = g->targets[e];
+                if (component[t] == c) continue;
+
+                if (counts.endless[u]) counts.endless[t] = true;
+                else count_add(&reached[t], &reached[u]);
+            }
+
+            if (graph_degree(g, u) > 0) {
+                free_count(&reached[u]);
+            } else if (counts.endless[u]) {
+                counts.total_endless = true;
+                free_count(&reached[u]);
+            } else {
+                count_add(&counts.total, &reached[u]);
+                counts.endings[u] = reached[u];
+                reached[u] = (PathCount){};
+            }
+        }
+    }
+
+    free(component);
+    free(first);
+    free(members);
+    free(reached);
+    return counts;
+}
+
+void free_path_counts(PathCounts *c) {
+    for (uint32_t i = 0; i < c->node_count; ++i) {
+        free(c->endings[i].limbs);
+    }
+    free(c->endings);
+    free(c->endless);
+    free(c->total.limbs);
+    *c = (PathCounts){};
+}
+
+/*
+ * Starts listing playthroughs of at most max_steps choices. How far
+ * each node is from an ending is worked out first, so the walk never
+ * goes anywhere it can't finish from in time: every step it takes
+ * leads to a playthrough.
+ */
+PathWalk path_walk(Graph *g, uint32_t max_steps) {
+    uint32_t const n = g->node_count;
+    PathWalk w = (PathWalk){
+        .g = g,
+        .max_steps = max_steps,
+        .distance = paths_alloc(n, sizeof(uint32_t)),
+        .path = paths_alloc((size_t)max_steps + 1, sizeof(uint32_t)),
+        .edge = paths_alloc((size_t)max_steps + 1, sizeof(uint32_t)),
+    };
+
+    Graph reverse = graph_reverse(g);
+    uint32_t *queue = paths_alloc(n, sizeof(uint32_t));
+    uint32_t head = 0, tail = 0;
+
+    for (uint32_t v = 0; v < n; ++v) {
+        w.distance[v] = UINT32_MAX;
+        if (graph_degree(g, v) == 0) {
+            w.distance[v] = 0;
+            queue[tail++] = v;
+        }
+    }
+
+    while (head < tail) {
+        uint32_t const v = queue[head++];
+        for (uint32_t e = reverse.first[v]; e < reverse.first[v + 1]; ++e) {
+            uint32_t const u = reverse.targets[e];
+            if (w.distance[u] == UINT32_MAX) {
+                w.distance[u] = w.distance[v] + 1;
+                queue[tail++] = u;
+            }
+        }
+    }
+
+    free(queue);
+    free_graph(&reverse);
+    return w;
+}
+
+/*
+ * Moves on to the next playthrough, depth first; false once there are
+ * none left.
+ */
+bool next_path(PathWalk *w) {
+    Graph *g = w->g;
+
+    if (!w->started) {
+        w->started = true;
+        if (g->node_count == 0 || w->distance[g->start] > w->max_steps) {
+            return false;
+        }
+        w->path[0] = g->start;
+        w->edge[0] = g->first[g->start];
+        w->len = 1;
+    } else if (w->len > 0) {
+        w->len--; // back off the last one's ending
+    }
+
+    while (w->len > 0) {
+        uint32_t const v = w->path[w->len - 1];
+
+        if (graph_degree(g, v) == 0) {
+            return true;
+        }
+        if (w->edge[w->len - 1] == g->first[v + 1]) {
+            w->len--;
+            continue;
+        }
+
+        uint32_t const t = g->targets[w->edge[w->len - 1]++];
+        // len - 1 steps so far, one more to get to t
+        if (w->distance[t] != UINT32_MAX && (uint64_t)w->len + w->distance[t] <= w->max_steps) {
+            w->path[w->len] = t;
+            w->edge[w->len] = g->first[t];
+            w->len++;
+        }
+    }
+    return false;
+}
+
+void free_path_walk(PathWalk *w) {
+    free(w->distance);
+    free(w->path);
+    free(w->edge);
+    *w = (PathWalk){};
+}
+
+/*
+ * Counts the playthroughs from every node to an ending, sinks first.
+ * Returns false, with nothing to free, when there's no playthrough to
+ * pick or infinitely many.
+ */
+bool path_sampler(Graph *g, uint64_t seed, PathSampler *s) {
+    uint32_t const n = g->node_count;
+    *s = (PathSampler){
+        .g = g,
+        .ways = paths_alloc(n, sizeof(PathCount)),
+        .rng = rng_seed(seed),
+    };
+
+    if (n == 0) {
+        free_path_sampler(s);
+        return false;
+    }
+
+    uint32_t *component = paths_alloc(n, sizeof(uint32_t));
+    uint32_t const count = graph_components(g, component);
+    uint32_t *first = paths_alloc(count + 1, sizeof(uint32_t));
+    uint32_t *members = paths_alloc(n, sizeof(uint32_t));
+    bool finite = true;
+
+    graph_component_members(g, component, count, first, members);
+
+    for (uint32_t c = 0; c < count && finite; ++c) {
+        uint32_t *nodes = members + first[c];
+        uint32_t const size = first[c + 1] - first[c];
+
+        if (component_cyclic(g, nodes, size)) {
+            // a loop only adds playthroughs if it can get to an ending
+            for (uint32_t i = 0; i < size; ++i) {
+                for (uint32_t e = g->first[nodes[i]]; e < g->first[nodes[i] + 1]; ++e) {
+                    if (s->ways[g->targets[e]].len > 0) finite = false;
+                }
+            }
+            continue;
+        }
+
+        uint32_t const u = nodes[0];
+        if (graph_degree(g, u) == 0) {
+            count_set_one(&s->ways[u]);
+        }
+        for (uint32_t e = g->first[u]; e < g->first[u + 1]; ++e) {
+            count_add(&s->ways[u], &s->ways[g->targets[e]]);
+        }
+    }
+
+    free(component);
+    free(first);
+    free(members);
+
+    if (!finite || s->ways[g->start].len == 0) {
+        free_path_sampler(s);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Picks a number below the count of playthroughs and follows the
+ * options it falls under. The path is always in original nodes.
+ */
+void sample_path(PathSampler *s) {
+    Graph *g = s->g;
+    uint32_t v = g->start;
+
+    count_random(&s->pick, &s->ways[v], &s->rng);
+    s->len = 0;
+
+    for (;;) {
+        // a compacted node plays all of its segments
+        uint32_t const segments = graph_steps(g, v) + 1;
+        while (s->len + segments > s->capacity) {
+            s->capacity = s->capacity > 0 ? s->capacity * 2 : 16;
+            s->path = realloc(s->path, sizeof(uint32_t) * s->capacity);
+            if (s->path == NULL) {
+                printf("Fatal error: can't realloc sampled path.");
+                exit(1);
+            }
+        }
+        if (g->segments != NULL) {
+            memcpy(s->path + s->len, g->segments + g->segment_first[v], sizeof(uint32_t) * segments);
+            s->len += segments;
+        } else {
+            s->path[s->len++] = v;
+        }
+
+        if (graph_degree(g, v) == 0) {
+            return;
+        }
+        for (uint32_t e = g->first[v]; e < g->first[v + 1]; ++e) {
+            PathCount *ways = &s->ways[g->targets[e]];
+            if (count_compare(&s->pick, ways) < 0) {
+                v = g->targets[e];
+                break;
+            }
+            count_sub(&s->pick, ways);
+        }
+    }
+}
+
+void free_path_sampler(PathSampler *s) {
+    if (s->ways != NULL) {
+        for (uint32_t i = 0; i < s->g->node_count; ++i) {
+            free(s->ways[i].limbs);
+        }
+    }
+    free(s->ways);
+    free(s->pick.limbs);
+    free(s->path);
+    *s = (PathSampler){};
+}
+
+/*
+ * Moves the counts of a compacted graph's nodes onto the original
+ * sections they end on.
+ */
+static void expand_path_counts(Graph *g, PathCounts *c) {
+    PathCount *endings = paths_alloc(g->original_count, sizeof(PathCount));
+    bool *endless = paths_alloc(g->original_count, sizeof(bool));
+
+    for (uint32_t i = 0; i < g->node_count; ++i) {
+        endings[graph_last_segment(g, i)] = c->endings[i];
+        endless[graph_last_segment(g, i)] = c->endless[i];
+    }
+
+    free(c->endings);
+    free(c->endless);
+    c->endings = endings;
+    c->endless = endless;
+    c->node_count = g->original_count;
+}
+
+static int compare_ending_counts(const void *a, const void *b) {
+    EndingCount const *x = a, *y = b;
+
+    if (x->endless != y->endless) {
+        return x->endless ? -1 : 1;
+    }
+    int const c = count_compare(y->count, x->count);
+    if (c != 0) {
+        return c;
+    }
+    return x->node < y->node ? -1 : x->node > y->node;
+}
+
+static void print_path(Adventure *adv, uint32_t *path, uint32_t len) {
+    printf(" ");
+    for (uint32_t i = 0; i < len; ++i) {
+        printf(" %zu", adv->sections[path[i]].id);
+    }
+    printf("\n");
+}
+
+/*
+ * Fills endings (counts->node_count of them) with the endings that can
+ * be reached and their counts, endless ones first, then the most
+ * likely. Returns how many there are.
+ */
+uint32_t ending_counts(Adventure *adv, PathCounts *counts, EndingCount *endings) {
+    uint32_t n = 0;
+
+    for (uint32_t v = 0; v < counts->node_count; ++v) {
+        if (adv->sections[v].option_count > 0) {
+            continue; // endless, but not an ending
+        }
+        if (counts->endless[v] || counts->endings[v].len > 0) {
+            endings[n++] = (EndingCount){ .node = v, .endless = counts->endless[v], .count = &counts->endings[v] };
+        }
+    }
+    qsort(endings, n, sizeof(EndingCount), compare_ending_counts);
+    return n;
+}
+
+static void print_path_counts(Adventure *adv, PathCounts *counts) {
+    EndingCount *endings = paths_alloc(counts->node_count, sizeof(EndingCount));
+    uint32_t const n = ending_counts(adv, counts, endings);
+
+    printf("playthroughs from the start to each ending:\n");
+    for (uint32_t i = 0; i < n; ++i) {
+        Section *s = &adv->sections[endings[i].node];
+
+        if (endings[i].endless) {
+            printf("  section %-8zu infinitely many, through a loop\n", s->id);
+        } else {
+            char *count = path_count_string(endings[i].count);
+            printf("  section %-8zu %s\n", s->id, count);
+            free(count);
+        }
+    }
+
+    if (counts->total_endless) {
+        printf("infinitely many in total\n");
+    } else {
+        char *total = path_count_string(&counts->total);
+        printf("%s in total\n", total);
+        free(total);
+    }
+
+    free(endings);
+}
+
+/*
+ * Entry point for adv paths: counts the playthroughs to every ending,
+ * then lists the first ones and random ones if asked to.
+ */
+bool print_paths(char *filename, PathsOptions options) {
+    Adventure adv;
+    if (!load_adventure_file(filename, &adv)) {
+        return false;
+    }
+
+    // counting and sampling can work on the compacted graph, listing
+    // goes option by option anyway
+    Graph g = adventure_graph(&adv);
+    Graph compacted = (Graph){};
+    Graph *counted = &g;
+    if (options.compact) {
+        compacted = compact_graph(&g);
+        counted = &compacted;
+        printf("%u sections compacted to %u nodes\n", g.node_count, compacted.node_count);
+    }
+
+    PathCounts counts = count_paths(counted);
+    if (counted->segments != NULL) {
+        expand_path_counts(counted, &counts);
+    }
+    print_path_counts(&adv, &counts);
+
+    if (options.first > 0) {
+        PathWalk w = path_walk(&g, options.max_steps);
+        uint64_t listed = 0;
+
+        printf("\nfirst playthroughs, in option order (at most %u steps):\n", options.max_steps);
+        for (; listed < options.first && next_path(&w); ++listed) {
+            print_path(&adv, w.path, w.len);
+        }
+        if (listed == 0) {
+            printf("  none\n");
+        }
+        free_path_walk(&w);
+    }
+
+    if (options.sample > 0) {
+        PathSampler s;
+
+        printf("\nplaythroughs picked at random (seed %llu):\n", (unsigned long long)options.seed);
+        if (path_sampler(counted, options.seed, &s)) {
+            for (uint64_t i = 0; i < options.sample; ++i) {
+                sample_path(&s);
+                print_path(&adv, s.path, s.len);
+            }
+            free_path_sampler(&s);
+        } else if (counts.total_endless) {
+            printf("  there are infinitely many, so none can be picked uniformly: try --first\n");
+        } else {
+            printf("  none\n");
+        }
+    }
+
+    free_path_counts(&counts);
+    free_graph(&compacted);
+    free_graph(&g);
+    free_adventure(&adv);
+    return true;
+}
@@ -0,0 +1,93 @@
+#ifndef TEXT_ADVENTURES_PATHS
+#define TEXT_ADVENTURES_PATHS
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parse.h"
+#include "graph.h"
+#include "rng.h"
+
+#define PATHS_DEFAULT_MAX_STEPS 10000
+
+typedef struct PathsOptions {
+    uint64_t first;     // playthroughs to list in option order
+    uint64_t sample;    // playthroughs to pick uniformly at random
+    uint64_t seed;
+    uint32_t max_steps; // longest playthrough listed
+    bool compact;       // count and sample with compact_graph
+} PathsOptions;
+
+/*
+ * A count of playthroughs, as big as it needs to be: limbs[0] holds the
+ * lowest 32 bits. Zero has no limbs.
+ */
+typedef struct PathCount {
+    uint32_t len, capacity;
+    uint32_t *limbs;
+} PathCount;
+
+/*
+ * How many different playthroughs, choice by choice, there are from
+ * the start to each ending.
+ */
+typedef struct PathCounts {
+    uint32_t node_count;
+    PathCount *endings; // per node, zero for anything but endings
+    bool *endless;      // per node: infinitely many, going round a loop
+    PathCount total;
+    bool total_endless;
+} PathCounts;
+
+/*
+ * An ending and how many playthroughs get there.
+ */
+typedef struct EndingCount {
+    uint32_t node;
+    bool endless;
+    PathCount *count;
+} EndingCount;
+
+/*
+ * Lists playthroughs one at a time in option order, only ever keeping
+ * the current one: path[0] .. path[len - 1].
+ */
+typedef struct PathWalk {
+    Graph *g;
+    uint32_t max_steps;
+    uint32_t *distance; // per node: fewest steps to an ending
+    uint32_t *path;
+    uint32_t *edge;     // per step: the next option to try from there
+    uint32_t len;
+    bool started;
+} PathWalk;
+
+/*
+ * Picks playthroughs uniformly at random, by how many of them follow
+ * each option.
+ */
+typedef struct PathSampler {
+    Graph *g;
+    PathCount *ways;    // per node: playthroughs from there to an ending
+    PathCount pick;
+    Rng rng;
+    uint32_t *path;
+    uint32_t len, capacity;
+} PathSampler;
+
+PathCounts count_paths(Graph *g);
+void free_path_counts(PathCounts *c);
+char *path_count_string(PathCount *c);
+uint32_t ending_counts(Adventure *adv, PathCounts *counts, EndingCount *endings);
+
+PathWalk path_walk(Graph *g, uint32_t max_steps);
+bool next_path(PathWalk *w);
+void free_path_walk(PathWalk *w);
+
+bool path_sampler(Graph *g, uint64_t seed, PathSampler *s);
+void sample_path(PathSampler *s);
+void free_path_sampler(PathSampler *s);
+
+bool print_paths(char *filename, PathsOptions options);
+
+#endif // TEXT_ADVENTURES_PATHS
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "render.h"
+
+#define FRAME_INITIAL_CAPACITY 4096
+
+/*
+ * Makes room for n more bytes.
+ */
+static char *reserve(Frame *f, size_t n) {
+    if (f->len + n > f->capacity) {
+        size_t capacity = f->capacity ? f->capacity : FRAME_INITIAL_CAPACITY;
+        while (capacity < f->len + n) capacity *= 2;
+
+        char *p = realloc(f->data, capacity);
+        if (p == NULL) {
+            printf("Fatal error: can't realloc frame.");
+            exit(1);
+        }
+
+        f->data = p;
+        f->capacity = capacity;
+    }
+
+    return f->data + f->len;
+}
+
+void frame_put(Frame *f, const char *s, size_t len) {
+    memcpy(reserve(f, len), s, len);
+    f->len += len;
+}
+
+void frame_puts(Frame *f, const char *s) {
+    frame_put(f, s, strlen(s));
+}
+
+void frame_putc(Frame *f, char c) {
+    *reserve(f, 1) = c;
+    f->len++;
+}
+
+/*
+ * Appends c n times.
+ */
+void frame_pad(Frame *f, char c, size_t n) {
+    memset(reserve(f, n), c, n);
+    f->len += n;
+}
+
+/*
+ * Like printf, returns how many chars were appended.
+ */
+int frame_printf(Frame *f, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    int const n = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    // vsnprintf needs room for the null char
+    reserve(f, n + 1);
+
+    va_start(args, format);
+    vsnprintf(f->data + f->len, n + 1, format, args);
+    va_end(args);
+
+    f->len += n;
+    return n;
+}
+
+/*
+ * Writes the frame out and empties it.
+ */
+void frame_flush(Frame *f, int fd) {
+    if (f->len == 0) return;
+
+    size_t written = 0;
+    while (written < f->len) {
+        ssize_t n = write(fd, f->data + written, f->len - written);
+        f->writes++;
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += n;
+    }
+
+    f->frames++;
+    f->bytes += written;
+    f->len = 0;
+}
+
+/*
+ * Writes as much of the frame as fd takes without blocking,
+ * keeping the rest for later. Returns how many bytes are still
+ * waiting, or -1 if fd failed.
+ */
+ssize_t frame_send(Frame *f, int fd) {
+    if (f->len == 0) return 0;
+
+    ssize_t n = write(fd, f->data, f->len);
+    f->writes++;
+
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? (ssize_t)f->len : -1;
+    }
+
+    f->bytes += n;
+    f->len -= n;
+    if (f->len > 0) {
+        memmove(f->data, f->data + n, f->len);
+    } else {
+        f->frames++;
+    }
+    return f->len;
+}
+
+/*
+ * frame_send, followed by len bytes of tail in the same writev.
+ * Advances *tail past what got written.
+ * Returns how many bytes of both are still waiting, or -1.
+ */
+ssize_t frame_send_tail(Frame *f, const char **tail, size_t *len, int fd) {
+    if (*len == 0) return frame_send(f, fd);
+
+    struct iovec iov[2] = {
+        { .iov_base = f->data, .iov_len = f->len },
+        { .iov_base = (void *)*tail, .iov_len = *len },
+    };
+    ssize_t n = writev(fd, f->len > 0 ? iov : iov + 1, f->len > 0 ? 2 : 1);
+    f->writes++;
+
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? (ssize_t)(f->len + *len) : -1;
+    }
+    f->bytes += n;
+
+    size_t const from_frame = (size_t)n < f->len ? (size_t)n : f->len;
+    f->len -= from_frame;
+    if (f->len > 0) {
+        memmove(f->data, f->data + from_frame, f->len);
+    }
+
+    *tail += n - from_frame;
+    *len -= n - from_frame;
+    if (f->len + *len == 0) {
+        f->frames++;
+    }
+    return f->len + *len;
+}
+
+/*
+ * Drops a finished frame without writing it,
+ * counting it as if it had been written.
+ */
+void frame_discard(Frame *f) {
+    if (f->len == 0) {
+        return;
+    }
+
+    f->frames++;
+    f->bytes += f->len;
+    f->len = 0;
+}
+
+void free_frame(Frame *f) {
+    free(f->data);
+    *f = (Frame){};
+}
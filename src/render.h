@@ -0,0 +1,32 @@
+#ifndef TEXT_ADVENTURES_RENDER
+#define TEXT_ADVENTURES_RENDER
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Output is built into a frame and written with a single write
+ * whenever the game waits for input.
+ */
+typedef struct Frame {
+    char *data;
+    size_t len, capacity;
+
+    // stats
+    size_t frames;  // flushes that wrote something
+    size_t writes;  // write syscalls
+    size_t bytes;   // bytes written
+} Frame;
+
+void frame_put(Frame *f, const char *s, size_t len);
+void frame_puts(Frame *f, const char *s);
+void frame_putc(Frame *f, char c);
+void frame_pad(Frame *f, char c, size_t n);
+int frame_printf(Frame *f, const char *format, ...);
+void frame_flush(Frame *f, int fd);
+ssize_t frame_send(Frame *f, int fd);
+ssize_t frame_send_tail(Frame *f, const char **tail, size_t *len, int fd);
+void frame_discard(Frame *f);
+void free_frame(Frame *f);
+
+#endif // TEXT_ADVENTURES_RENDER
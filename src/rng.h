@@ -0,0 +1,66 @@
+#ifndef TEXT_ADVENTURES_RNG
+#define TEXT_ADVENTURES_RNG
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * xoshiro256** (Blackman and Vigna), for anything played out at random.
+ * Not thread safe: give each thread its own.
+ */
+typedef struct Rng {
+    uint64_t s[4];
+} Rng;
+
+static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(Rng *r) {
+    uint64_t *s = r->s;
+    uint64_t const result = rotl(s[1] * 5, 7) * 9;
+    uint64_t const t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
+/*
+ * Seeds the generator from a single number with splitmix64.
+ */
+static inline Rng rng_seed(uint64_t seed) {
+    Rng r;
+    for (int i = 0; i < 4; ++i) {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        r.s[i] = z ^ (z >> 31);
+    }
+    return r;
+}
+
+/*
+ * Advances the generator by 2^128 steps: jump each thread's generator
+ * once more than the one before, so their sequences never overlap.
+ */
+static inline void rng_jump(Rng *r) {
+    static const uint64_t jump[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+    uint64_t s[4] = {0};
+
+    for (int i = 0; i < 4; ++i) {
+        for (int b = 0; b < 64; ++b) {
+            if (jump[i] & (uint64_t)1 << b) {
+                for (int j = 0; j < 4; ++j) s[j] ^= r->s[j];
+            }
+            rng_next(r);
+        }
+    }
+    memcpy(r->s, s, sizeof(s));
+}
+
+#endif // TEXT_ADVENTURES_RNG
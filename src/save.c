@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "save.h"
+
+/*
+ * Bytes save_session needs for s.
+ */
+size_t save_size(Session *s) {
+    return sizeof(SaveHeader) + s->history_len;
+}
+
+/*
+ * Writes s into out, if it fits in capacity.
+ * Returns the size of the save either way.
+ */
+size_t save_session(Session *s, uint8_t *out, size_t capacity) {
+    size_t const size = save_size(s);
+    if (size > capacity) {
+        return size;
+    }
+
+    SaveHeader const h = (SaveHeader){
+        .magic = SAVE_MAGIC,
+        .format = SAVE_FORMAT,
+        .content_hash = s->adv->content_hash,
+        .origin = s->origin,
+        .section = s->section,
+        .history_len = s->history_len,
+    };
+
+    memcpy(out, &h, sizeof(h));
+    memcpy(out + sizeof(h), s->history, s->history_len);
+    return size;
+}
+
+/*
+ * Whether taking the options in history, one byte each, from section
+ * origin leads to section. Indices out of range never do.
+ */
+bool history_leads_to(Adventure *adv, uint32_t origin, const uint8_t *history, uint32_t len, uint32_t section) {
+    if (origin >= adv->section_count || section >= adv->section_count) {
+        return false;
+    }
+
+    uint32_t at = origin;
+    for (uint32_t i = 0; i < len; ++i) {
+        Section *cs = &adv->sections[at];
+        if (history[i] >= cs->option_count) {
+            return false;
+        }
+
+        Section *next = find_section(adv, section_options(cs)[history[i]].section_id);
+        if (next == NULL) {
+            return false; // dangling options are never taken
+        }
+        at = next - adv->sections;
+    }
+    return at == section;
+}
+
+/*
+ * Checks a save against s's adventure by taking every option in its
+ * history, and on success puts s at the saved section. s has to be
+ * freshly initialized; it's left alone when the save is rejected.
+ */
+enum SaveResult restore_session(Session *s, const uint8_t *save, size_t len) {
+    SaveHeader h;
+    Adventure *adv = s->adv;
+
+    if (len < sizeof(h)) {
+        return SAVE_NOT_A_SAVE;
+    }
+    memcpy(&h, save, sizeof(h));
+
+    if (memcmp(h.magic, SAVE_MAGIC, sizeof(h.magic)) != 0 || len != sizeof(h) + h.history_len) {
+        return SAVE_NOT_A_SAVE;
+    }
+    if (h.format != SAVE_FORMAT) {
+        return SAVE_OTHER_FORMAT;
+    }
+    if (h.content_hash != adv->content_hash) {
+        return SAVE_OTHER_ADVENTURE;
+    }
+    if (h.history_len > SESSION_HISTORY) {
+        return SAVE_CORRUPT; // never saved, and the session couldn't cap it
+    }
+
+    const uint8_t *history = save + sizeof(h);
+    if (!history_leads_to(adv, h.origin, history, h.history_len, h.section)) {
+        return SAVE_CORRUPT;
+    }
+
+    if (h.history_len > s->history_capacity) {
+        uint8_t *p = realloc(s->history, h.history_len);
+        if (p == NULL) {
+            printf("Fatal error: can't realloc session history.");
+            exit(1);
+        }
+        s->history = p;
+        s->history_capacity = h.history_len;
+    }
+
+    memcpy(s->history, history, h.history_len);
+    s->history_len = h.history_len;
+    s->origin = h.origin;
+    s->section = h.section;
+    return SAVE_OK;
+}
+
+const char *save_result_message(enum SaveResult r) {
+    switch (r) {
+        case SAVE_OK: return "Game restored.";
+        case SAVE_NOT_A_SAVE: return "Not a saved game!";
+        case SAVE_OTHER_FORMAT: return "The game was saved by another version of adv!";
+        case SAVE_OTHER_ADVENTURE: return "The game was saved from another adventure!";
+        default: return "The saved game is corrupt!";
+    }
+}
+
+/*
+ * Flushes the directory filename is in, so a rename in it is on disk.
+ */
+static bool sync_directory(char *filename) {
+    char dir[4096];
+    char *slash = strrchr(filename, '/');
+
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (slash == filename) {
+        strcpy(dir, "/");
+    } else if (snprintf(dir, sizeof(dir), "%.*s", (int)(slash - filename), filename) >= (int)sizeof(dir)) {
+        return false;
+    }
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool const ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+/*
+ * Saves s to filename. The save is written next to it, flushed to disk
+ * and renamed over it, so a crash leaves either the old save or the
+ * new one.
+ */
+bool save_session_file(Session *s, char *filename) {
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", filename) >= (int)sizeof(tmp)) {
+        return false;
+    }
+
+    size_t const size = save_size(s);
+    uint8_t *buffer = malloc(size);
+    if (buffer == NULL) {
+        printf("Fatal error: can't malloc save.");
+        exit(1);
+    }
+    save_session(s, buffer, size);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && write(fd, buffer, size) == (ssize_t)size && fsync(fd) == 0;
+
+    if (fd >= 0) {
+        ok &= close(fd) == 0;
+    }
+    ok = ok && rename(tmp, filename) == 0 && sync_directory(filename);
+
+    if (!ok) {
+        unlink(tmp);
+    }
+    free(buffer);
+    return ok;
+}
+
+/*
+ * Restores s from filename, see restore_session.
+ */
+enum SaveResult restore_session_file(Session *s, char *filename) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        return SAVE_NOT_A_SAVE;
+    }
+
+    uint8_t *buffer = malloc(st.st_size > 0 ? st.st_size : 1);
+    if (buffer == NULL) {
+        printf("Fatal error: can't malloc save.");
+        exit(1);
+    }
+
+    ssize_t const len = read(fd, buffer, st.st_size);
+    close(fd);
+
+    enum SaveResult r = len == st.st_size ? restore_session(s, buffer, len) : SAVE_NOT_A_SAVE;
+    free(buffer);
+    return r;
+}
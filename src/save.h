@@ -0,0 +1,47 @@
+#ifndef TEXT_ADVENTURES_SAVE
+#define TEXT_ADVENTURES_SAVE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parse.h"
+#include "adventure.h"
+
+#define SAVE_MAGIC "ADVS"
+#define SAVE_FORMAT 2
+
+/*
+ * A saved session: this header, then history_len option indices,
+ * one byte each. Taking them from section origin leads to section.
+ * Numbers are in the machine's byte order.
+ */
+typedef struct SaveHeader {
+    char magic[4];
+    uint16_t format;
+    uint16_t reserved;
+    uint64_t content_hash; // Adventure.content_hash it was saved from
+    uint32_t origin;       // section indices
+    uint32_t section;
+    uint32_t history_len;
+    uint32_t reserved2;
+} SaveHeader;
+
+enum SaveResult {
+    SAVE_OK,
+    SAVE_NOT_A_SAVE,       // bad magic or cut short
+    SAVE_OTHER_FORMAT,
+    SAVE_OTHER_ADVENTURE,  // the content hash doesn't match
+    SAVE_CORRUPT,          // the history doesn't lead to the saved section
+};
+
+bool history_leads_to(Adventure *adv, uint32_t origin, const uint8_t *history, uint32_t len, uint32_t section);
+size_t save_size(Session *s);
+size_t save_session(Session *s, uint8_t *out, size_t capacity);
+enum SaveResult restore_session(Session *s, const uint8_t *save, size_t len);
+const char *save_result_message(enum SaveResult r);
+
+bool save_session_file(Session *s, char *filename);
+enum SaveResult restore_session_file(Session *s, char *filename);
+
+#endif // TEXT_ADVENTURES_SAVE
@@ -0,0 +1,630 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "parse.h"
+#include "render.h"
+#include "input.h"
+#include "adventure.h"
+#include "server.h"
+
+// epoll data for the fds that aren't connections
+static char listener_tag, stop_tag;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * Opens the socket sessions connect to: a UNIX socket at
+ * options.socket, or a TCP port on the loopback interface.
+ */
+static int open_listener(ServeOptions options) {
+    int fd;
+
+    if (options.socket != NULL) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (strlen(options.socket) >= sizeof(addr.sun_path)) {
+            printf("Socket path is too long!\n");
+            return -1;
+        }
+        strcpy(addr.sun_path, options.socket);
+        unlink(options.socket);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            printf("Can't listen on %s!\n", options.socket);
+            return -1;
+        }
+
+    } else {
+        struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(options.port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        int const yes = 1;
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        }
+        if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            printf("Can't listen on port %d!\n", options.port);
+            return -1;
+        }
+    }
+
+    listen(fd, SOMAXCONN);
+    return fd;
+}
+
+static void watch_fd(ServerLoop *loop, int fd, uint32_t events, void *data) {
+    struct epoll_event e = { .events = events, .data.ptr = data };
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &e);
+}
+
+static void close_connection(ServerLoop *loop, Connection *c) {
+    close(c->fd); // also takes it out of epoll
+    loop->partial_count -= c->partial_time != 0;
+
+    if (loop->server->storing) {
+        // players who didn't finish can resume later
+        store_release(&loop->server->store, c->record, c->session.state != SESSION_OVER);
+    }
+
+    Connection *last = loop->connections[--loop->connection_count];
+    loop->connections[c->slot] = last;
+    last->slot = c->slot;
+    loop->server->connected--;
+
+    if (c->cached != NULL) {
+        frame_cache_release(&loop->server->frames, c->cached);
+    }
+
+    free_session(&c->session);
+    free_frame(&c->out);
+    free(c);
+}
+
+/*
+ * Renders the session and writes its output. Keys that were waiting
+ * for it count as answered once all of it is written.
+ * Returns false when the connection was closed.
+ */
+static bool send_output(ServerLoop *loop, Connection *c) {
+    ssize_t left;
+
+    while (true) {
+        // nothing new is rendered until a cached section is out
+        if (c->cached == NULL) {
+            if (!session_render(&c->session, &c->out)) {
+                c->closing = true;
+            }
+
+            c->cached = session_take_frame(&c->session);
+            c->tail = c->cached != NULL ? c->cached->data : NULL;
+            c->tail_len = c->cached != NULL ? c->cached->len : 0;
+        }
+
+        left = frame_send_tail(&c->out, &c->tail, &c->tail_len, c->fd);
+        if (left != 0 || c->cached == NULL) {
+            break;
+        }
+
+        // written: keys typed meanwhile can be rendered now
+        frame_cache_release(&loop->server->frames, c->cached);
+        c->cached = NULL;
+    }
+
+    if (left < 0) {
+        close_connection(loop, c);
+        return false;
+    }
+
+    if (left > 0) {
+        if (!c->writing) {
+            struct epoll_event e = { .events = EPOLLIN | EPOLLOUT, .data.ptr = c };
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, c->fd, &e);
+            c->writing = true;
+        }
+        return true;
+    }
+
+    if (c->key_time != 0) {
+        uint64_t const us = (now_ns() - c->key_time) / 1000;
+        loop->latency[us < LATENCY_BUCKETS ? us : LATENCY_BUCKETS - 1]++;
+        loop->frames++;
+        c->key_time = 0;
+    }
+
+    if (c->closing) {
+        close_connection(loop, c);
+        return false;
+    }
+
+    if (c->writing) {
+        struct epoll_event e = { .events = EPOLLIN, .data.ptr = c };
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, c->fd, &e);
+        c->writing = false;
+    }
+
+    // idle connections don't keep an output buffer around
+    free_frame(&c->out);
+    return true;
+}
+
+/*
+ * Accepts pending connections, showing each new session
+ * the first section. Other loops take turns with the rest.
+ */
+static void accept_connections(ServerLoop *loop) {
+    Server *sv = loop->server;
+
+    for (int i = 0; i < SERVER_MAX_EVENTS; ++i) {
+        int const fd = accept(sv->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        int const yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)); // fails harmlessly on UNIX sockets
+
+        Connection *c = calloc(1, sizeof(Connection));
+        if (c == NULL) {
+            printf("Fatal error: can't calloc connection.");
+            exit(1);
+        }
+
+        if (loop->connection_count == loop->connection_capacity) {
+            loop->connection_capacity = loop->connection_capacity ? loop->connection_capacity * 2 : 64;
+            Connection **p = realloc(loop->connections, sizeof(Connection *) * loop->connection_capacity);
+
+            if (p == NULL) {
+                printf("Fatal error: can't realloc connections.");
+                exit(1);
+            }
+            loop->connections = p;
+        }
+
+        c->fd = fd;
+        c->slot = loop->connection_count;
+        input_init(&c->in, fd);
+        session_init(&c->session, &sv->adv, &loop->layouts, sv->width);
+        loop->connections[loop->connection_count++] = c;
+
+        if (sv->storing) {
+            // the terminal title tells the player how to resume the session
+            c->record = store_add(&sv->store, &c->token);
+            frame_printf(&c->out, "\x1b]0;adv session %u %016llx\x07", c->record, (unsigned long long)c->token);
+        }
+
+        if (sv->caching) {
+            c->session.frames = &sv->frames;
+        }
+
+        if (sv->logging) {
+            c->session.log = &sv->log;
+            c->session.id = choice_log_session(&sv->log);
+        }
+        loop->served++;
+
+        size_t const connected = ++sv->connected;
+        size_t peak = sv->peak;
+        while (connected > peak && !atomic_compare_exchange_weak(&sv->peak, &peak, connected));
+
+        watch_fd(loop, fd, EPOLLIN, c);
+        send_output(loop, c);
+    }
+}
+
+static int hex_digit(unsigned char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/*
+ * A connection whose first line is "resume <id> <token>" takes over
+ * stored session <id>, if the token is the one shown when it started
+ * and nobody else is playing it. Anything else is keys.
+ * Returns false while that line could still be coming.
+ */
+static bool take_resume(ServerLoop *loop, Connection *c) {
+    static const char prefix[] = "resume ";
+    size_t const prefix_len = sizeof(prefix) - 1;
+    Server *sv = loop->server;
+    unsigned char *p = c->in.data + c->in.start;
+    size_t const len = c->in.len;
+    size_t i = 0;
+
+    while (i < len && i < prefix_len && p[i] == prefix[i]) i++;
+
+    uint32_t id = 0;
+    uint64_t token = 0;
+    size_t digits = 0, hex_digits = 0;
+    if (i == prefix_len) {
+        while (i < len && digits < 10 && p[i] >= '0' && p[i] <= '9') {
+            id = id * 10 + (p[i++] - '0');
+            digits++;
+        }
+        if (digits > 0 && i < len && p[i] == ' ') {
+            i++;
+            while (i < len && hex_digits < 16 && hex_digit(p[i]) >= 0) {
+                token = token << 4 | hex_digit(p[i++]);
+                hex_digits++;
+            }
+        }
+    }
+
+    if (i == len && !c->in.eof) {
+        return false;
+    }
+    c->keyed = true;
+
+    if (hex_digits != 16 || i == len || p[i] != '\n') {
+        return true;
+    }
+    c->in.start += i + 1;
+    c->in.len -= i + 1;
+
+    if (store_resume(&sv->store, id, token, &c->session)) {
+        store_release(&sv->store, c->record, false);
+        c->record = id;
+        c->token = token;
+        if (sv->logging && c->session.id == CHOICE_LOG_NO_SESSION) {
+            c->session.id = choice_log_session(&sv->log); // it wasn't logged before
+        }
+        session_resumed(&c->session);
+        frame_printf(&c->out, "\x1b]0;adv session %u %016llx\x07", c->record, (unsigned long long)c->token);
+    }
+    return true;
+}
+
+/*
+ * Feeds the keys a connection sent to its session, up to the first
+ * one that changes what it shows: the keys after it were typed ahead
+ * for the next section, so they stay in the buffer until it's rendered.
+ * A key only partly there waits for the rest, unless flush is set:
+ * see input_key. Sessions that moved are written to the store.
+ * Returns true when keys were left for after rendering.
+ */
+static bool feed_keys(ServerLoop *loop, Connection *c, uint64_t now, bool flush) {
+    bool fed = false;
+    Key key;
+
+    while (c->session.state == SESSION_ASKING && input_key(&c->in, &key, flush) == INPUT_KEY) {
+        enum Transition const t = session_feed(&c->session, key);
+        fed = true;
+
+        if (t == TRANSITION_MOVED || t == TRANSITION_ENDED) {
+            if (loop->server->storing) {
+                store_put(&loop->server->store, c->record, &c->session);
+            }
+        }
+    }
+
+    if (fed && c->key_time == 0) {
+        c->key_time = now;
+    }
+
+    // most likely an escape sequence on its way, or a lone Esc
+    bool const partial = c->session.state == SESSION_ASKING && input_pending(&c->in);
+    if (partial != (c->partial_time != 0)) {
+        c->partial_time = partial ? now : 0;
+        loop->partial_count += partial ? 1 : -1;
+    }
+
+    return c->session.state != SESSION_ASKING && c->session.state != SESSION_OVER && input_pending(&c->in);
+}
+
+/*
+ * Reads the keys a connection sent and feeds them to its session.
+ * Returns true when keys were left for after rendering.
+ */
+static bool read_keys(ServerLoop *loop, Connection *c, uint64_t now) {
+    bool const open = input_fill(&c->in);
+
+    c->closing |= !open;
+    if (loop->server->storing && !c->keyed && !take_resume(loop, c)) {
+        return false;
+    }
+    return feed_keys(loop, c, now, false);
+}
+
+/*
+ * Takes keys left partly there for INPUT_ESCAPE_TIMEOUT as they are,
+ * like the terminal does: that's how a lone Esc gets through.
+ */
+static void flush_partial_keys(ServerLoop *loop, uint64_t now) {
+    uint64_t const timeout = (uint64_t)INPUT_ESCAPE_TIMEOUT * 1000000;
+
+    // closing a connection moves the last one into its slot
+    for (size_t i = loop->connection_count; i-- > 0 && loop->partial_count > 0;) {
+        Connection *c = loop->connections[i];
+        if (c->partial_time == 0 || now - c->partial_time < timeout) continue;
+
+        bool more = feed_keys(loop, c, now, true);
+        while (send_output(loop, c) && more) {
+            more = feed_keys(loop, c, now, false);
+        }
+    }
+}
+
+/*
+ * Runs one event loop until the server stops.
+ */
+static void *run_loop(void *arg) {
+    ServerLoop *loop = arg;
+    Server *sv = loop->server;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    layout_cache_init(&loop->layouts, sv->adv.section_count);
+    watch_fd(loop, sv->listen_fd, EPOLLIN | EPOLLEXCLUSIVE, &listener_tag);
+    watch_fd(loop, sv->stop_fds[0], EPOLLIN, &stop_tag);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    bool running = true;
+
+    while (running) {
+        int const n = epoll_wait(loop->epoll_fd, events, SERVER_MAX_EVENTS, loop->partial_count > 0 ? INPUT_ESCAPE_TIMEOUT : -1);
+        uint64_t const now = now_ns();
+
+        for (int i = 0; i < n; ++i) {
+            void *data = events[i].data.ptr;
+
+            if (data == &listener_tag) {
+                accept_connections(loop);
+            } else if (data == &stop_tag) {
+                running = false;
+            } else {
+                Connection *c = data;
+                bool more = false;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    more = read_keys(loop, c, now);
+                }
+
+                // keys typed ahead go to each section once it's shown
+                while (send_output(loop, c) && more) {
+                    more = feed_keys(loop, c, now, false);
+                }
+            }
+        }
+
+        if (loop->partial_count > 0) {
+            flush_partial_keys(loop, now);
+        }
+    }
+
+    while (loop->connection_count > 0) {
+        close_connection(loop, loop->connections[0]);
+    }
+
+    close(loop->epoll_fd);
+    free_layout_cache(&loop->layouts);
+    free(loop->connections);
+    return NULL;
+}
+
+static uint32_t percentile(uint32_t *latency, size_t frames, double p) {
+    size_t const target = frames * p;
+    size_t seen = 0;
+
+    for (uint32_t us = 0; us < LATENCY_BUCKETS; ++us) {
+        seen += latency[us];
+        if (seen > target) {
+            return us;
+        }
+    }
+    return LATENCY_BUCKETS - 1;
+}
+
+static void print_report(Server *sv, double wall) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double const cpu = seconds(usage.ru_utime) + seconds(usage.ru_stime);
+
+    // every loop's latencies in one histogram
+    uint32_t *latency = sv->loops[0].latency;
+    size_t served = 0, frames = 0;
+
+    for (size_t i = 0; i < sv->loop_count; ++i) {
+        served += sv->loops[i].served;
+        frames += sv->loops[i].frames;
+        for (size_t us = 0; i > 0 && us < LATENCY_BUCKETS; ++us) {
+            latency[us] += sv->loops[i].latency[us];
+        }
+    }
+
+    fprintf(
+        stderr, "served %zu sessions, at most %zu at once on %zu loop(s): %.0f per core, %.1f%% busy over %.1f s\n",
+        served, sv->peak, sv->loop_count, (double)sv->peak / sv->loop_count,
+        wall > 0 ? 100 * cpu / wall / sv->loop_count : 0, wall
+    );
+
+    if (frames > 0) {
+        fprintf(
+            stderr, "keypress to frame: p50 %u us, p99 %u us over %zu frames\n",
+            percentile(latency, frames, 0.5), percentile(latency, frames, 0.99), frames
+        );
+    }
+
+    if (sv->storing) {
+        fprintf(
+            stderr, "session store: %zu checkpoints, %zu pages written\n",
+            sv->store.checkpoints, sv->store.pages_flushed
+        );
+    }
+
+    if (sv->caching) {
+        size_t const lookups = sv->frames.hits + sv->frames.misses;
+        fprintf(
+            stderr, "frame cache: %.1f%% hits over %zu frames, %zu kept in %zu bytes, %zu evicted\n",
+            lookups > 0 ? 100.0 * sv->frames.hits / lookups : 0, lookups,
+            sv->frames.entries, sv->frames.bytes, sv->frames.evictions
+        );
+    }
+
+    if (sv->logging && sv->log.commits > 0) {
+        fprintf(
+            stderr, "choice log: %llu choices in %zu syncs, %.1f per sync\n",
+            (unsigned long long)sv->log.durable_count, sv->log.commits,
+            (double)sv->log.durable_count / sv->log.commits
+        );
+    }
+}
+
+/*
+ * Serves the adventure to every session that connects, until
+ * SIGINT or SIGTERM. Sessions are spread over options.threads epoll
+ * loops, each on its own thread with its own layout cache; rendered
+ * sections are shared through the frame cache. With a session store,
+ * sessions are checkpointed every STORE_CHECKPOINT_MS.
+ */
+bool serve_adventure(char *filename, ServeOptions options) {
+    Server *sv = calloc(1, sizeof(Server));
+    if (sv == NULL) {
+        printf("Fatal error: can't calloc server.");
+        exit(1);
+    }
+
+    if (!load_adventure_file(filename, &sv->adv)) {
+        free(sv);
+        return false;
+    }
+    sv->width = options.width;
+    sv->loop_count = options.threads > 0 ? options.threads : 1;
+
+    sv->listen_fd = open_listener(options);
+    if (sv->listen_fd < 0 || pipe(sv->stop_fds) != 0) {
+        free_adventure(&sv->adv);
+        free(sv);
+        return false;
+    }
+
+    if (options.store != NULL) {
+        uint64_t const opened = now_ns();
+        enum StoreResult const r = store_open(&sv->store, options.store, &sv->adv);
+
+        if (r != STORE_OK) {
+            printf(r == STORE_OTHER_ADVENTURE ? "The session store holds another adventure!\n" : "Can't open the session store!\n");
+            close(sv->listen_fd);
+            free_adventure(&sv->adv);
+            free(sv);
+            return false;
+        }
+
+        sv->storing = true;
+        fprintf(
+            stderr, "session store: %u sessions to resume, mapped in %.2f ms\n",
+            sv->store.resumable, (now_ns() - opened) / 1e6
+        );
+    }
+
+    if (options.log != NULL) {
+        enum ChoiceLogResult const r = choice_log_open(&sv->log, options.log, &sv->adv);
+
+        if (r != CHOICE_LOG_OK) {
+            printf(r == CHOICE_LOG_OTHER_ADVENTURE ? "The choice log is for another adventure!\n" : "Can't open the choice log!\n");
+            if (sv->storing) store_close(&sv->store);
+            close(sv->listen_fd);
+            free_adventure(&sv->adv);
+            free(sv);
+            return false;
+        }
+        sv->logging = true;
+    }
+
+    if (options.frame_cache > 0) {
+        frame_cache_init(&sv->frames, options.frame_cache);
+        sv->caching = true;
+    }
+
+    sv->loops = calloc(sv->loop_count, sizeof(ServerLoop));
+    if (sv->loops == NULL) {
+        printf("Fatal error: can't calloc server loops.");
+        exit(1);
+    }
+
+    // loops inherit the blocked signals, only this thread takes them
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stop, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    uint64_t const start = now_ns();
+
+    for (size_t i = 0; i < sv->loop_count; ++i) {
+        sv->loops[i].server = sv;
+        pthread_create(&sv->loops[i].thread, NULL, run_loop, &sv->loops[i]);
+    }
+
+    if (sv->storing) {
+        struct timespec const interval = { .tv_nsec = STORE_CHECKPOINT_MS * 1000000 };
+        while (sigtimedwait(&stop, NULL, &interval) < 0) {
+            store_checkpoint(&sv->store);
+        }
+    } else {
+        int signal_number;
+        sigwait(&stop, &signal_number);
+    }
+
+    close(sv->stop_fds[1]); // wakes every loop up
+    for (size_t i = 0; i < sv->loop_count; ++i) {
+        pthread_join(sv->loops[i].thread, NULL);
+    }
+
+    if (sv->storing) {
+        store_checkpoint(&sv->store);
+    }
+    if (sv->logging) {
+        choice_log_sync(&sv->log);
+    }
+    print_report(sv, (now_ns() - start) / 1e9);
+
+    if (options.socket != NULL) {
+        unlink(options.socket);
+    }
+
+    if (sv->storing) {
+        store_close(&sv->store);
+    }
+    if (sv->logging) {
+        choice_log_close(&sv->log);
+    }
+    if (sv->caching) {
+        free_frame_cache(&sv->frames);
+    }
+
+    close(sv->listen_fd);
+    close(sv->stop_fds[0]);
+    free(sv->loops);
+    free_adventure(&sv->adv);
+    free(sv);
+    return true;
+}
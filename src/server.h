@@ -0,0 +1,89 @@
+#ifndef TEXT_ADVENTURES_SERVER
+#define TEXT_ADVENTURES_SERVER
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "parse.h"
+#include "adventure.h"
+#include "input.h"
+#include "layout.h"
+#include "render.h"
+#include "store.h"
+#include "choicelog.h"
+#include "framecache.h"
+
+#define SERVER_MAX_EVENTS 256
+#define LATENCY_BUCKETS 10000 // one per microsecond, the last one counts anything slower
+#define STORE_CHECKPOINT_MS 100
+#define SERVER_FRAME_CACHE_MB 16
+
+typedef struct ServeOptions {
+    char *socket;   // UNIX socket path
+    int port;       // TCP port on 127.0.0.1, used when there's no socket
+    uint16_t width; // columns every session is rendered to
+    int threads;    // event loops, one per core
+    char *store;    // file sessions are kept in across restarts
+    char *log;      // file every choice is logged to
+    size_t frame_cache; // bytes of rendered sections to keep, 0 for none
+} ServeOptions;
+
+/*
+ * A player connected to the server.
+ */
+typedef struct Connection {
+    int fd;
+    uint32_t slot;     // index in ServerLoop.connections
+    bool closing;      // close once the output is written
+    bool writing;      // waiting for the socket to take more output
+    uint64_t key_time; // when the oldest unanswered key arrived (ns), 0 if none
+    uint64_t partial_time; // when part of a key was left in the input (ns), 0 if none
+    Frame out;         // rendered, not written yet
+    CachedFrame *cached; // goes out after out
+    const char *tail;    // what's left of it to write
+    size_t tail_len;
+    Session session;
+    Input in;
+    uint32_t record;   // in the session store
+    uint64_t token;    // resuming the record takes it
+    bool keyed;        // past the point where it could ask to resume
+} Connection;
+
+/*
+ * An epoll loop on its own thread, running the sessions it accepted.
+ */
+typedef struct ServerLoop {
+    struct Server *server;
+    pthread_t thread;
+    int epoll_fd;
+    LayoutCache layouts;
+    size_t connection_count, connection_capacity;
+    Connection **connections;
+    size_t partial_count; // connections with part of a key waiting
+
+    // stats
+    size_t served, frames;
+    uint32_t latency[LATENCY_BUCKETS]; // keypress to frame written, in us
+} ServerLoop;
+
+typedef struct Server {
+    Adventure adv; // shared by every loop, read only
+    uint16_t width;
+    int listen_fd;
+    int stop_fds[2]; // closing stop_fds[1] stops the loops
+    size_t loop_count;
+    ServerLoop *loops;
+    _Atomic size_t connected, peak;
+    bool storing;
+    SessionStore store;
+    bool logging;
+    ChoiceLog log;
+    bool caching;
+    FrameCache frames;
+} Server;
+
+bool serve_adventure(char *filename, ServeOptions options);
+
+#endif // TEXT_ADVENTURES_SERVER
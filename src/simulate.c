@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "parse.h"
+#include "graph.h"
+#include "simulate.h"
+#include "rng.h"
+
+static void *sim_calloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+
+    if (p == NULL) {
+        printf("Fatal error: can't calloc simulation.");
+        exit(1);
+    }
+    return p;
+}
+
+static Simulation new_simulation(uint32_t node_count, uint32_t max_steps) {
+    return (Simulation){
+        .max_steps = max_steps,
+        .endings = sim_calloc(node_count, sizeof(uint64_t)),
+        .visits = sim_calloc(node_count, sizeof(uint64_t)),
+        .lengths = sim_calloc((size_t)max_steps + 1, sizeof(uint64_t)),
+    };
+}
+
+typedef struct SimulationThread {
+    pthread_t thread;
+    Graph *g;
+    uint64_t runs;
+    Rng rng;
+    Simulation counts; // this thread's only, merged at the end
+} SimulationThread;
+
+static void *run_playthroughs(void *arg) {
+    SimulationThread *t = arg;
+    Graph *g = t->g;
+    uint32_t const *first = g->first, *targets = g->targets;
+    uint32_t const max_steps = t->counts.max_steps;
+    uint64_t *visits = t->counts.visits, *endings = t->counts.endings, *lengths = t->counts.lengths;
+    uint64_t transitions = 0, cut_off = 0;
+    Rng rng = t->rng;
+
+    for (uint64_t run = 0; run < t->runs; ++run) {
+        uint32_t at = g->start, steps = 0;
+
+        while (true) {
+            visits[at]++;
+            steps += graph_steps(g, at);
+            if (steps > max_steps) {
+                steps = max_steps;
+                cut_off++;
+                break;
+            }
+
+            uint32_t const begin = first[at], degree = first[at + 1] - begin;
+            if (degree == 0) {
+                endings[at]++;
+                lengths[steps]++;
+                break;
+            }
+            if (steps == max_steps) {
+                cut_off++;
+                break;
+            }
+
+            // uniform in [0, degree) without a division
+            at = targets[begin + (uint32_t)(((rng_next(&rng) >> 32) * degree) >> 32)];
+            steps++;
+        }
+        transitions += steps;
+    }
+
+    t->counts.runs = t->runs;
+    t->counts.transitions = transitions;
+    t->counts.cut_off = cut_off;
+    return NULL;
+}
+
+/*
+ * Plays options.runs random playthroughs of g from its start, spread
+ * over options.threads threads.
+ */
+Simulation simulate(Graph *g, SimulateOptions options) {
+    int threads = options.threads > 0 ? options.threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if ((uint64_t)threads > options.runs && options.runs > 0) threads = options.runs;
+
+    SimulationThread *t = sim_calloc(threads, sizeof(SimulationThread));
+    Rng rng = rng_seed(options.seed);
+
+    for (int i = 0; i < threads; ++i) {
+        t[i].g = g;
+        t[i].runs = options.runs / threads + ((uint64_t)i < options.runs % threads);
+        t[i].rng = rng;
+        t[i].counts = new_simulation(g->node_count, options.max_steps);
+        rng_jump(&rng);
+        pthread_create(&t[i].thread, NULL, run_playthroughs, &t[i]);
+    }
+
+    Simulation out = new_simulation(g->node_count, options.max_steps);
+    out.threads = threads;
+
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(t[i].thread, NULL);
+        Simulation *c = &t[i].counts;
+
+        out.runs += c->runs;
+        out.transitions += c->transitions;
+        out.cut_off += c->cut_off;
+
+        for (uint32_t n = 0; n < g->node_count; ++n) {
+            out.endings[n] += c->endings[n];
+            out.visits[n] += c->visits[n];
+        }
+        for (uint32_t l = 0; l <= options.max_steps; ++l) {
+            out.lengths[l] += c->lengths[l];
+        }
+        free_simulation(c);
+    }
+
+    free(t);
+    return out;
+}
+
+void free_simulation(Simulation *s) {
+    free(s->endings);
+    free(s->visits);
+    free(s->lengths);
+    *s = (Simulation){};
+}
+
+/*
+ * Picks up to SIMULATE_SHOWN sections with the biggest counts,
+ * biggest first. Returns how many sections have a count at all.
+ */
+static size_t top_sections(uint64_t *counts, uint32_t n, uint32_t *top, size_t *shown) {
+    size_t nonzero = 0;
+    *shown = 0;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        if (counts[i] == 0) continue;
+        nonzero++;
+
+        if (*shown < SIMULATE_SHOWN) {
+            top[(*shown)++] = i;
+        } else if (counts[i] > counts[top[SIMULATE_SHOWN - 1]]) {
+            top[SIMULATE_SHOWN - 1] = i;
+        } else {
+            continue;
+        }
+
+        for (size_t j = *shown - 1; j > 0 && counts[top[j - 1]] < counts[top[j]]; --j) {
+            uint32_t const swap = top[j];
+            top[j] = top[j - 1];
+            top[j - 1] = swap;
+        }
+    }
+    return nonzero;
+}
+
+static uint32_t length_percentile(Simulation *s, uint64_t ended, double p) {
+    uint64_t const target = ended * p;
+    uint64_t seen = 0;
+
+    for (uint32_t l = 0; l <= s->max_steps; ++l) {
+        seen += s->lengths[l];
+        if (seen > target) return l;
+    }
+    return s->max_steps;
+}
+
+static void print_simulation(Adventure *adv, Simulation *s, double seconds) {
+    uint32_t top[SIMULATE_SHOWN];
+    size_t shown;
+    uint64_t const ended = s->runs - s->cut_off;
+
+    printf(
+        "%llu runs, %llu transitions in %.3f s on %d thread(s): %.1fM transitions/s\n",
+        (unsigned long long)s->runs, (unsigned long long)s->transitions, seconds, s->threads,
+        seconds > 0 ? s->transitions / seconds / 1e6 : 0
+    );
+
+    size_t const endings = top_sections(s->endings, adv->section_count, top, &shown);
+    printf("\nendings reached (%zu):\n", endings);
+    for (size_t i = 0; i < shown; ++i) {
+        printf(
+            "  section %-8zu %6.2f%%  (%llu)\n", adv->sections[top[i]].id,
+            100.0 * s->endings[top[i]] / s->runs, (unsigned long long)s->endings[top[i]]
+        );
+    }
+    if (endings > shown) {
+        printf("  ... and %zu more\n", endings - shown);
+    }
+    if (s->cut_off > 0) {
+        printf(
+            "  no ending in %u steps %5.2f%%  (%llu)\n", s->max_steps,
+            100.0 * s->cut_off / s->runs, (unsigned long long)s->cut_off
+        );
+    }
+
+    if (ended > 0) {
+        uint32_t longest = 0;
+        double total = 0;
+        for (uint32_t l = 0; l <= s->max_steps; ++l) {
+            total += (double)l * s->lengths[l];
+            if (s->lengths[l] > 0) longest = l;
+        }
+
+        printf(
+            "\npath length: mean %.2f, p50 %u, p90 %u, p99 %u, max %u\n",
+            total / ended, length_percentile(s, ended, 0.5), length_percentile(s, ended, 0.9),
+            length_percentile(s, ended, 0.99), longest
+        );
+    }
+
+    size_t const visited = top_sections(s->visits, adv->section_count, top, &shown);
+    printf("\nmost visited sections (%zu of %zu visited):\n", visited, adv->section_count);
+    for (size_t i = 0; i < shown; ++i) {
+        printf(
+            "  section %-8zu %8.3f visits per run\n", adv->sections[top[i]].id,
+            (double)s->visits[top[i]] / s->runs
+        );
+    }
+}
+
+/*
+ * Moves what a simulation of a compacted graph counted back onto the
+ * original nodes: every segment of a node is visited as often as it
+ * is, and it ends on its last.
+ */
+static void expand_simulation(Graph *g, Simulation *s) {
+    uint64_t *endings = sim_calloc(g->original_count, sizeof(uint64_t));
+    uint64_t *visits = sim_calloc(g->original_count, sizeof(uint64_t));
+
+    for (uint32_t v = 0; v < g->original_count; ++v) {
+        visits[v] = s->visits[g->node_of[v]];
+    }
+    for (uint32_t i = 0; i < g->node_count; ++i) {
+        endings[graph_last_segment(g, i)] = s->endings[i];
+    }
+
+    free(s->endings);
+    free(s->visits);
+    s->endings = endings;
+    s->visits = visits;
+}
+
+/*
+ * Entry point for adv simulate: loads the adventure, simulates it
+ * and prints the report.
+ */
+bool simulate_adventure(char *filename, SimulateOptions options) {
+    Adventure adv;
+    if (!load_adventure_file(filename, &adv)) {
+        return false;
+    }
+
+    Graph g = adventure_graph(&adv);
+    if (options.compact) {
+        Graph compact = compact_graph(&g);
+        printf("%u sections compacted to %u nodes\n", g.node_count, compact.node_count);
+        free_graph(&g);
+        g = compact;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Simulation s = simulate(&g, options);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (g.segments != NULL) {
+        expand_simulation(&g, &s);
+    }
+
+    double const seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    print_simulation(&adv, &s, seconds);
+
+    free_simulation(&s);
+    free_graph(&g);
+    free_adventure(&adv);
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef TEXT_ADVENTURES_SIMULATE
+#define TEXT_ADVENTURES_SIMULATE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "parse.h"
+#include "graph.h"
+
+#define SIMULATE_DEFAULT_RUNS 1000000
+#define SIMULATE_DEFAULT_MAX_STEPS 10000
+#define SIMULATE_SHOWN 10 // endings and sections listed in the report
+
+typedef struct SimulateOptions {
+    uint64_t runs;
+    int threads;        // 0 for one per core
+    uint64_t seed;
+    uint32_t max_steps; // playthroughs this long are cut off
+    bool compact;       // simulate with compact_graph
+} SimulateOptions;
+
+/*
+ * What random playthroughs did: every choice is uniform.
+ */
+typedef struct Simulation {
+    uint64_t runs;
+    uint64_t transitions;
+    uint64_t cut_off;  // runs that hit max_steps
+    uint32_t max_steps;
+    int threads;
+    uint64_t *endings; // per section: runs that ended there
+    uint64_t *visits;  // per section, counting where runs start and end
+    uint64_t *lengths; // per path length, 0 .. max_steps
+} Simulation;
+
+Simulation simulate(Graph *g, SimulateOptions options);
+void free_simulation(Simulation *s);
+bool simulate_adventure(char *filename, SimulateOptions options);
+
+#endif // TEXT_ADVENTURES_SIMULATE
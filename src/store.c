@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+
+#include "parse.h"
+#include "adventure.h"
+#include "choicelog.h"
+#include "save.h"
+#include "store.h"
+
+static size_t file_size(SessionStore *st, uint32_t capacity) {
+    size_t const records = sizeof(StoreRecord) * capacity;
+    return st->page_size + (records + st->page_size - 1) / st->page_size * st->page_size;
+}
+
+static uint64_t fnv_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+static uint32_t record_check(StoreRecord *r) {
+    uint64_t h = fnv_bytes(0xcbf29ce484222325, r, offsetof(StoreRecord, check));
+    h = fnv_bytes(h, r->history, sizeof(r->history));
+    return (uint32_t)(h ^ h >> 32);
+}
+
+/*
+ * Whether a live record is whole and its history leads from its
+ * origin to its section in adv.
+ */
+static bool record_fits(StoreRecord *r, Adventure *adv) {
+    return r->check == record_check(r) && r->history_len <= STORE_HISTORY &&
+        history_leads_to(adv, r->origin, r->history, r->history_len, r->section);
+}
+
+/*
+ * A token nobody can guess, so only whoever was given a session can
+ * resume it.
+ */
+static uint64_t new_token() {
+    uint64_t token = 0;
+
+    while (token == 0) {
+        ssize_t const n = getrandom(&token, sizeof(token), 0);
+
+        if (n != sizeof(token) && !(n < 0 && errno == EINTR)) {
+            printf("Fatal error: can't get random bytes.");
+            exit(1);
+        }
+    }
+    return token;
+}
+
+static void mark_dirty(SessionStore *st, void *p) {
+    size_t const page = ((char *)p - st->base) / st->page_size;
+    atomic_fetch_or(&st->dirty[page / 64], (uint64_t)1 << (page % 64));
+}
+
+/*
+ * Maps the file with room for capacity records, growing it if needed.
+ * The dirty bits and attached flags grow along with it.
+ */
+static bool map_records(SessionStore *st, uint32_t capacity) {
+    size_t const size = file_size(st, capacity);
+    size_t const old_pages = st->size / st->page_size;
+    size_t const old_words = (old_pages + 63) / 64;
+    size_t const words = (size / st->page_size + 63) / 64;
+
+    if (st->base != NULL) {
+        munmap(st->base, st->size);
+        st->base = NULL;
+    }
+
+    struct stat s;
+    if (fstat(st->fd, &s) != 0 || ((size_t)s.st_size < size && ftruncate(st->fd, size) != 0)) {
+        return false;
+    }
+
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, st->fd, 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    _Atomic uint64_t *dirty = realloc(st->dirty, sizeof(uint64_t) * words);
+    uint8_t *attached = realloc(st->attached, capacity);
+
+    if (dirty == NULL || attached == NULL) {
+        printf("Fatal error: can't realloc session store.");
+        exit(1);
+    }
+
+    for (size_t i = old_words; i < words; ++i) {
+        dirty[i] = 0;
+    }
+    memset(attached + st->capacity, 0, capacity - st->capacity);
+
+    st->base = base;
+    st->size = size;
+    st->records = (StoreRecord *)(base + st->page_size);
+    st->capacity = capacity;
+    st->dirty = dirty;
+    st->attached = attached;
+
+    StoreHeader *h = (StoreHeader *)base;
+    if (h->capacity != capacity) {
+        h->capacity = capacity;
+        mark_dirty(st, h);
+    }
+    return true;
+}
+
+/*
+ * Opens the session store in filename, creating it if it's missing.
+ * Sessions left in it by a previous run can be resumed if they were
+ * saved from the same adventure; records that don't fit adv are
+ * dropped.
+ */
+enum StoreResult store_open(SessionStore *st, char *filename, Adventure *adv) {
+    *st = (SessionStore){ .page_size = sysconf(_SC_PAGESIZE) };
+
+    st->fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat s;
+
+    if (st->fd < 0 || fstat(st->fd, &s) != 0) {
+        if (st->fd >= 0) close(st->fd);
+        return STORE_ERROR;
+    }
+
+    StoreHeader h = (StoreHeader){
+        .magic = STORE_MAGIC,
+        .content_hash = adv->content_hash,
+        .record_size = sizeof(StoreRecord),
+        .capacity = STORE_INITIAL_RECORDS,
+    };
+    bool const fresh = s.st_size == 0;
+
+    if (!fresh) {
+        StoreHeader found;
+        bool const read_ok = pread(st->fd, &found, sizeof(found), 0) == sizeof(found);
+
+        if (!read_ok || memcmp(found.magic, STORE_MAGIC, sizeof(found.magic)) != 0 ||
+            found.record_size != sizeof(StoreRecord) || found.capacity == 0 ||
+            (size_t)s.st_size < file_size(st, found.capacity)) {
+            close(st->fd);
+            return STORE_ERROR;
+        }
+
+        if (found.content_hash != adv->content_hash) {
+            close(st->fd);
+            return STORE_OTHER_ADVENTURE;
+        }
+        h.capacity = found.capacity;
+
+    } else if (pwrite(st->fd, &h, sizeof(h), 0) != sizeof(h)) {
+        close(st->fd);
+        return STORE_ERROR;
+    }
+
+    if (pthread_rwlock_init(&st->lock, NULL) != 0 || !map_records(st, h.capacity)) {
+        store_close(st);
+        return STORE_ERROR;
+    }
+
+    if (fresh) {
+        mark_dirty(st, st->base);
+    }
+
+    for (uint32_t i = 0; i < st->capacity; ++i) {
+        StoreRecord *r = &st->records[i];
+        if (!r->live) continue;
+
+        if (!record_fits(r, adv)) {
+            r->live = 0;
+            mark_dirty(st, r);
+            continue;
+        }
+        st->resumable++;
+    }
+
+    return STORE_OK;
+}
+
+/*
+ * Hands out a free record for a new session, starting at the first
+ * section, and the token resuming it takes (unless token is NULL).
+ * The store doubles when it's full.
+ */
+uint32_t store_add(SessionStore *st, uint64_t *token) {
+    pthread_rwlock_wrlock(&st->lock);
+
+    uint32_t id = STORE_NO_RECORD;
+    for (uint32_t n = 0; n < st->capacity; ++n) {
+        uint32_t const i = (st->next_free + n) % st->capacity;
+        if (!st->records[i].live && !st->attached[i]) {
+            id = i;
+            break;
+        }
+    }
+
+    if (id == STORE_NO_RECORD) {
+        id = st->capacity;
+        if (!map_records(st, st->capacity * 2)) {
+            printf("Fatal error: can't grow session store.");
+            exit(1);
+        }
+    }
+
+    st->records[id] = (StoreRecord){ .token = new_token(), .live = 1, .log_session = CHOICE_LOG_NO_SESSION };
+    st->records[id].check = record_check(&st->records[id]);
+    if (token != NULL) *token = st->records[id].token;
+    st->attached[id] = 1;
+    st->next_free = id + 1;
+    mark_dirty(st, &st->records[id]);
+
+    pthread_rwlock_unlock(&st->lock);
+    return id;
+}
+
+/*
+ * Writes where s is into its record. A checkpoint may flush it half
+ * written; it's marked dirty again after, so the next one writes it
+ * whole.
+ */
+void store_put(SessionStore *st, uint32_t id, Session *s) {
+    pthread_rwlock_rdlock(&st->lock);
+
+    StoreRecord *r = &st->records[id];
+    r->section = s->section;
+    r->log_session = s->log != NULL ? s->id : CHOICE_LOG_NO_SESSION;
+
+    if (s->history_len <= STORE_HISTORY) {
+        r->origin = s->origin;
+        r->history_len = s->history_len;
+        memcpy(r->history, s->history, s->history_len);
+    } else {
+        r->origin = s->section;
+        r->history_len = 0;
+    }
+    r->check = record_check(r);
+    mark_dirty(st, r);
+
+    pthread_rwlock_unlock(&st->lock);
+}
+
+/*
+ * Puts s where the session in record id was, if token is the one it
+ * was handed out with, nobody is playing it and the record still fits
+ * s's adventure. s has to be freshly initialized.
+ */
+bool store_resume(SessionStore *st, uint32_t id, uint64_t token, Session *s) {
+    pthread_rwlock_wrlock(&st->lock);
+
+    bool const ok = id < st->capacity && st->records[id].live && st->records[id].token == token &&
+        !st->attached[id] && record_fits(&st->records[id], s->adv);
+    if (ok) {
+        StoreRecord *r = &st->records[id];
+
+        if (r->history_len > s->history_capacity) {
+            uint8_t *p = realloc(s->history, r->history_len);
+            if (p == NULL) {
+                printf("Fatal error: can't realloc session history.");
+                exit(1);
+            }
+            s->history = p;
+            s->history_capacity = r->history_len;
+        }
+
+        memcpy(s->history, r->history, r->history_len);
+        s->history_len = r->history_len;
+        s->origin = r->origin;
+        s->section = r->section;
+        s->id = r->log_session;
+        st->attached[id] = 1;
+    }
+
+    pthread_rwlock_unlock(&st->lock);
+    return ok;
+}
+
+/*
+ * The connection playing record id is gone. Unless keep is set,
+ * the session is over and its record can be reused.
+ */
+void store_release(SessionStore *st, uint32_t id, bool keep) {
+    pthread_rwlock_wrlock(&st->lock);
+
+    st->attached[id] = 0;
+    if (!keep) {
+        st->records[id].live = 0;
+        mark_dirty(st, &st->records[id]);
+        if (id < st->next_free) st->next_free = id;
+    }
+
+    pthread_rwlock_unlock(&st->lock);
+}
+
+/*
+ * Writes the pages changed since the last checkpoint to disk,
+ * a run of consecutive pages per msync. Only the read lock is held,
+ * to keep the mapping in place: sessions go on moving meanwhile, and
+ * a record torn on disk fails its check and is dropped on open.
+ * Returns how many pages were written.
+ */
+size_t store_checkpoint(SessionStore *st) {
+    pthread_rwlock_rdlock(&st->lock);
+
+    size_t const pages = st->size / st->page_size;
+    size_t flushed = 0, run = 0;
+    uint64_t bits = 0;
+
+    // one past the last page, so the last run gets flushed too
+    for (size_t page = 0; page <= pages; ++page) {
+        if (page % 64 == 0 && page < pages) {
+            bits = atomic_exchange(&st->dirty[page / 64], 0);
+        }
+
+        if (page < pages && (bits >> (page % 64) & 1)) {
+            run++;
+        } else if (run > 0) {
+            msync(st->base + (page - run) * st->page_size, run * st->page_size, MS_SYNC);
+            flushed += run;
+            run = 0;
+        }
+    }
+
+    pthread_rwlock_unlock(&st->lock);
+
+    st->checkpoints++;
+    st->pages_flushed += flushed;
+    return flushed;
+}
+
+/*
+ * Checkpoints and closes the store. Live sessions stay in the file.
+ */
+void store_close(SessionStore *st) {
+    if (st->base != NULL) {
+        store_checkpoint(st);
+        munmap(st->base, st->size);
+        pthread_rwlock_destroy(&st->lock);
+    }
+
+    close(st->fd);
+    free((void *)st->dirty);
+    free(st->attached);
+    *st = (SessionStore){ .fd = -1 };
+}
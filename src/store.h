@@ -0,0 +1,82 @@
+#ifndef TEXT_ADVENTURES_STORE
+#define TEXT_ADVENTURES_STORE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "parse.h"
+#include "adventure.h"
+
+#define STORE_MAGIC "ADVSTOR4"
+#define STORE_HISTORY 40          // history bytes a record keeps
+#define STORE_INITIAL_RECORDS 1024
+#define STORE_NO_RECORD UINT32_MAX
+
+/*
+ * First page of a session store file. Records follow on the next page.
+ */
+typedef struct StoreHeader {
+    char magic[8];
+    uint64_t content_hash; // Adventure.content_hash the sections belong to
+    uint32_t record_size;
+    uint32_t capacity;
+} StoreHeader;
+
+/*
+ * A session, by section index. Histories longer than STORE_HISTORY
+ * aren't kept: the record then starts over at the current section.
+ * The page a record is on can be written back while it's changing, so
+ * records whose check doesn't match are dropped when the store opens.
+ */
+typedef struct StoreRecord {
+    uint64_t token;        // random, resuming the session takes it
+    uint32_t live;
+    uint32_t section;
+    uint32_t origin;
+    uint32_t history_len;
+    uint32_t log_session;  // its choices are logged under, see choicelog.h
+    uint32_t check;        // FNV-1a of the rest of the record
+    uint8_t history[STORE_HISTORY];
+} StoreRecord;
+
+/*
+ * Sessions kept in a file mapped in memory, indexed by record id.
+ * Writing a record marks its page dirty, and checkpoints msync just
+ * the dirty pages. Safe to use from several threads.
+ */
+typedef struct SessionStore {
+    int fd;
+    char *base; // mapping of the whole file
+    size_t size;
+    size_t page_size;
+    StoreRecord *records;
+    uint32_t capacity;
+    uint32_t next_free;     // where looking for a free record starts
+    _Atomic uint64_t *dirty; // a bit per page of records
+    uint8_t *attached;      // records a connection is playing right now
+    pthread_rwlock_t lock;  // held for writing to remap or hand out records
+
+    // stats
+    uint32_t resumable;     // live records found when opening
+    size_t checkpoints;
+    size_t pages_flushed;
+} SessionStore;
+
+enum StoreResult {
+    STORE_OK,
+    STORE_OTHER_ADVENTURE, // the file holds sessions of another adventure
+    STORE_ERROR,
+};
+
+enum StoreResult store_open(SessionStore *st, char *filename, Adventure *adv);
+uint32_t store_add(SessionStore *st, uint64_t *token);
+void store_put(SessionStore *st, uint32_t id, Session *s);
+bool store_resume(SessionStore *st, uint32_t id, uint64_t token, Session *s);
+void store_release(SessionStore *st, uint32_t id, bool keep);
+size_t store_checkpoint(SessionStore *st);
+void store_close(SessionStore *st);
+
+#endif // TEXT_ADVENTURES_STORE
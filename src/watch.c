@@ -0,0 +1,586 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "parse.h"
+#include "hint.h"
+#include "watch.h"
+
+// window of sections to parse again is wrapped like this
+#define WINDOW_HEAD "{\"sections\":["
+#define WINDOW_TAIL "]}"
+
+static void *watch_alloc(size_t size) {
+    void *p = malloc(size);
+
+    if (p == NULL) {
+        printf("Fatal error: can't malloc memory.");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * Reads a whole file into memory.
+ * Returns NULL if it can't be read.
+ */
+static char *read_file(char *filename, size_t *len) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+
+    if (size <= 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    char *out = watch_alloc(size);
+    *len = fread(out, 1, size, f);
+    fclose(f);
+
+    if (*len != (size_t)size) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+/*
+ * Saves the byte range of every section object.
+ * This has to happen before json_to_adventure frees the parsed list.
+ */
+static SourceSpan *section_spans(Object *adventure, size_t offset) {
+    for (size_t i = 0; i < adventure->relation_count; ++i) {
+        Relation *r = &adventure->relations[i];
+        if (r->value_type != VALUE_LIST || utf8cmp("sections", r->key.chars) != 0) continue;
+
+        List *l = r->value.list;
+        SourceSpan *out = watch_alloc(sizeof(SourceSpan) * (l->object_count + 1));
+
+        for (size_t j = 0; j < l->object_count; ++j) {
+            out[j] = (SourceSpan){
+                .begin = l->elements[j].begin - offset,
+                .end = l->elements[j].end - offset,
+            };
+        }
+        return out;
+    }
+
+    return NULL;
+}
+
+/*
+ * How far section i moved since it was last parsed. shifts is a
+ * Fenwick tree of how much longer each edit made the source, so an
+ * edit doesn't have to move every span after it.
+ */
+static ptrdiff_t span_shift(WatchedAdventure *wa, size_t i) {
+    ptrdiff_t shift = 0;
+    for (size_t j = i + 1; j > 0; j -= j & -j) {
+        shift += wa->shifts[j];
+    }
+    return shift;
+}
+
+/*
+ * Byte range of section i in the current source.
+ */
+SourceSpan watch_span(WatchedAdventure *wa, size_t i) {
+    ptrdiff_t const shift = span_shift(wa, i);
+    return (SourceSpan){ .begin = wa->spans[i].begin + shift, .end = wa->spans[i].end + shift };
+}
+
+/*
+ * Moves section from and every one after it by delta bytes.
+ */
+static void add_shift(WatchedAdventure *wa, size_t from, ptrdiff_t delta) {
+    for (size_t j = from + 1; j <= wa->adv.section_count; j += j & -j) {
+        wa->shifts[j] += delta;
+    }
+}
+
+/*
+ * Writes where every section is into spans, and starts the shifts over
+ * for count sections.
+ */
+static void settle_spans(WatchedAdventure *wa, size_t count) {
+    for (size_t i = wa->adv.section_count; i-- > 0;) {
+        wa->spans[i] = watch_span(wa, i);
+    }
+
+    free(wa->shifts);
+    wa->shifts = watch_alloc(sizeof(ptrdiff_t) * (count + 1));
+    memset(wa->shifts, 0, sizeof(ptrdiff_t) * (count + 1));
+}
+
+static size_t spilling(Section *sections, size_t count) {
+    size_t n = 0;
+    for (size_t i = 0; i < count; ++i) {
+        n += sections[i].option_count > SECTION_INLINE_OPTIONS;
+    }
+    return n;
+}
+
+static void free_patch_pools(WatchedAdventure *wa) {
+    for (size_t i = 0; i < wa->pool_count; ++i) {
+        free(wa->pools[i].options);
+    }
+    free(wa->pools);
+    wa->pools = NULL;
+    wa->pool_count = 0;
+}
+
+/*
+ * Sections that are being replaced no longer use the pool their options
+ * spilled to. Pools nobody uses are freed.
+ */
+static void release_options(WatchedAdventure *wa, Section *sections, size_t count) {
+    Adventure *adv = &wa->adv;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (sections[i].option_count <= SECTION_INLINE_OPTIONS) continue;
+        Option *options = sections[i].spilled_options;
+
+        if (options >= adv->option_pool && options < adv->option_pool + adv->option_pool_size) {
+            if (--wa->option_pool_users == 0) {
+                free(adv->option_pool);
+                adv->option_pool = NULL;
+                adv->option_pool_size = 0;
+            }
+            continue;
+        }
+
+        for (size_t j = 0; j < wa->pool_count; ++j) {
+            PatchPool *p = &wa->pools[j];
+            if (options < p->options || options >= p->options + p->size) continue;
+
+            if (--p->users == 0) {
+                free(p->options);
+                *p = wa->pools[--wa->pool_count];
+            }
+            break;
+        }
+    }
+}
+
+/*
+ * Text of replaced sections stays in the string pool, since it may be
+ * shared. Once the pool has doubled since it was last compacted, it's
+ * built again from the text still in use.
+ */
+static void compact_strings(WatchedAdventure *wa) {
+    Adventure *adv = &wa->adv;
+    if (adv->strings->bytes <= 2 * wa->string_bytes) {
+        return;
+    }
+
+    StringPool *p = new_string_pool();
+    for (size_t i = 0; i < adv->section_count; ++i) {
+        Section *s = &adv->sections[i];
+        Option *options = section_options(s);
+
+        s->text = intern_string(p, strdup(s->text));
+        for (size_t j = 0; j < s->option_count; ++j) {
+            options[j].text = intern_string(p, strdup(options[j].text));
+        }
+    }
+
+    free_string_pool(adv->strings);
+    adv->strings = p;
+    wa->string_bytes = p->bytes;
+}
+
+/*
+ * Whether json_parse used up all of f, leaving only whitespace.
+ * If not, sets parse_state like a parse error.
+ */
+static bool parsed_to_end(FILE *f) {
+    int c;
+    while ((c = fgetc(f)) != EOF) {
+        if (!isspace(c)) {
+            parse_state = PS_ERROR;
+            parse_error = PE_INVALID_CHAR;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Parses the whole source and replaces the adventure with it.
+ */
+static enum WatchResult full_reload(WatchedAdventure *wa, char *source, size_t len) {
+    FILE *f = fmemopen(source, len, "r");
+    if (f == NULL) return WATCH_ERROR;
+
+    Object o = json_parse(f);
+    if (parse_state != PS_OK || !parsed_to_end(f)) {
+        fclose(f);
+        return WATCH_ERROR;
+    }
+
+    SourceSpan *spans = section_spans(&o, 0);
+    Adventure adv = json_to_adventure(o);
+    fclose(f);
+
+    if (parse_state != PS_OK) {
+        free(spans);
+        return WATCH_ERROR;
+    }
+
+    size_t const current_id = wa->adv.current_section ? wa->adv.current_section->id : 0;
+
+    free_adventure(&wa->adv);
+    free_patch_pools(wa);
+    free(wa->spans);
+    free(wa->shifts);
+    wa->adv = adv;
+    wa->spans = spans;
+    wa->shifts = watch_alloc(sizeof(ptrdiff_t) * (adv.section_count + 1));
+    memset(wa->shifts, 0, sizeof(ptrdiff_t) * (adv.section_count + 1));
+    wa->option_pool_users = spilling(adv.sections, adv.section_count);
+    wa->string_bytes = adv.strings->bytes;
+
+    wa->adv.current_section = find_section(&wa->adv, current_id);
+    if (wa->adv.current_section == NULL) {
+        wa->adv.current_section = wa->adv.sections;
+    }
+
+    return WATCH_RELOADED;
+}
+
+/*
+ * Whether two runs of sections have the same ids, and options leading
+ * to the same sections.
+ */
+static bool same_graph(Section *a, Section *b, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (a[i].id != b[i].id || a[i].option_count != b[i].option_count) {
+            return false;
+        }
+
+        Option *x = section_options(&a[i]), *y = section_options(&b[i]);
+        for (size_t j = 0; j < a[i].option_count; ++j) {
+            if (x[j].section_id != y[j].section_id) return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Parses again only the sections between first and last (inclusive)
+ * of the old source, which now span [begin, end) of the new source.
+ * The window may now hold any number of sections. When it holds as
+ * many as before, nothing outside it is touched: the sections are
+ * replaced in place, the content hash only changes around the window,
+ * and the id index and hints are only built again if ids or options
+ * changed.
+ */
+static enum WatchResult patch_sections(
+    WatchedAdventure *wa, char *source, size_t first, size_t last, size_t begin, size_t end
+) {
+    size_t const window_len = end - begin;
+    size_t const head_len = strlen(WINDOW_HEAD), tail_len = strlen(WINDOW_TAIL);
+    char *window = watch_alloc(head_len + window_len + tail_len);
+
+    memcpy(window, WINDOW_HEAD, head_len);
+    memcpy(window + head_len, source + begin, window_len);
+    memcpy(window + head_len + window_len, WINDOW_TAIL, tail_len);
+
+    FILE *f = fmemopen(window, head_len + window_len + tail_len, "r");
+    if (f == NULL) {
+        free(window);
+        return WATCH_ERROR;
+    }
+
+    // an edit can close the wrapper early, the rest must not be ignored
+    Object o = json_parse(f);
+    if (parse_state != PS_OK || !parsed_to_end(f) || o.relation_count != 1 || o.relations[0].value_type != VALUE_LIST) {
+        fclose(f);
+        free(window);
+        return WATCH_ERROR;
+    }
+
+    List *list = o.relations[0].value.list;
+    size_t const count = list->object_count;
+    SourceSpan *spans = section_spans(&o, head_len);
+    Option *pool;
+    size_t pool_size;
+    Section *patched = json_to_section(list, &pool, &pool_size);
+    fclose(f);
+    free(window);
+
+    if (parse_state != PS_OK) {
+        free(spans);
+        return WATCH_ERROR;
+    }
+
+    Adventure *adv = &wa->adv;
+    size_t const current_id = adv->current_section->id;
+    size_t const removed = last - first + 1;
+    size_t const section_count = adv->section_count - removed + count;
+    ptrdiff_t const delta = (ptrdiff_t)end - (ptrdiff_t)watch_span(wa, last).end;
+
+    // only the pairs of sections the window is in change the hash
+    Section *before = first > 0 ? &adv->sections[first - 1] : NULL;
+    Section *after = last + 1 < adv->section_count ? &adv->sections[last + 1] : NULL;
+    intern_sections(adv->strings, patched, count);
+    uint64_t const old_hash = hash_section_run(before, adv->sections + first, removed, after);
+    uint64_t const new_hash = hash_section_run(before, patched, count, after);
+
+    // the id index holds while sections keep their ids and places,
+    // hints while their options lead to the same sections too
+    bool const same_edges = count == removed && same_graph(adv->sections + first, patched, count);
+    bool same_ids = count == removed;
+    for (size_t i = 0; same_ids && i < count; ++i) {
+        same_ids = adv->sections[first + i].id == patched[i].id;
+    }
+
+    release_options(wa, adv->sections + first, removed);
+    if (pool != NULL) {
+        wa->pools = realloc(wa->pools, sizeof(PatchPool) * (wa->pool_count + 1));
+        if (wa->pools == NULL) {
+            printf("Fatal error: can't realloc memory.");
+            exit(1);
+        }
+        wa->pools[wa->pool_count++] = (PatchPool){
+            .options = pool,
+            .size = pool_size,
+            .users = spilling(patched, count),
+        };
+    }
+
+    if (count == removed) {
+        memcpy(adv->sections + first, patched, sizeof(Section) * count);
+        for (size_t i = 0; i < count; ++i) {
+            ptrdiff_t const shift = span_shift(wa, first + i);
+            wa->spans[first + i] = (SourceSpan){
+                .begin = spans[i].begin + begin - shift,
+                .end = spans[i].end + begin - shift,
+            };
+        }
+        add_shift(wa, last + 1, delta);
+
+    } else {
+        // sections after the window move, so they're indexed again
+        size_t const moved = adv->section_count - last - 1;
+        settle_spans(wa, section_count);
+
+        if (section_count > adv->section_count) {
+            adv->sections = realloc(adv->sections, sizeof(Section) * section_count);
+            wa->spans = realloc(wa->spans, sizeof(SourceSpan) * (section_count + 1));
+            if (adv->sections == NULL || wa->spans == NULL) {
+                printf("Fatal error: can't realloc memory.");
+                exit(1);
+            }
+        }
+
+        memmove(adv->sections + first + count, adv->sections + last + 1, sizeof(Section) * moved);
+        memmove(wa->spans + first + count, wa->spans + last + 1, sizeof(SourceSpan) * moved);
+        memcpy(adv->sections + first, patched, sizeof(Section) * count);
+
+        for (size_t i = 0; i < count; ++i) {
+            wa->spans[first + i] = (SourceSpan){ .begin = spans[i].begin + begin, .end = spans[i].end + begin };
+        }
+        for (size_t i = first + count; i < section_count; ++i) {
+            wa->spans[i].begin += delta;
+            wa->spans[i].end += delta;
+        }
+    }
+
+    adv->section_count = section_count;
+    adv->content_hash += new_hash - old_hash;
+    free(patched);
+    free(spans);
+
+    if (!same_ids) {
+        free(adv->id_index);
+        index_sections(adv);
+    }
+    if (!same_edges) {
+        free(adv->ending_distance);
+        free(adv->hint_option);
+        build_hints(adv);
+    }
+    compact_strings(wa);
+
+    adv->current_section = find_section(adv, current_id);
+    if (adv->current_section == NULL) {
+        adv->current_section = adv->sections;
+    }
+
+    return WATCH_PATCHED;
+}
+
+/*
+ * Length of the common prefix of a and b, up to len bytes,
+ * compared a block at a time.
+ */
+static size_t common_prefix(const char *a, const char *b, size_t len) {
+    size_t i = 0;
+    while (i + 64 <= len && memcmp(a + i, b + i, 64) == 0) i += 64;
+    while (i < len && a[i] == b[i]) i++;
+    return i;
+}
+
+/*
+ * Length of the common suffix of a and b, up to len bytes.
+ */
+static size_t common_suffix(const char *a, size_t a_len, const char *b, size_t b_len, size_t len) {
+    size_t i = 0;
+    while (i + 64 <= len && memcmp(a + a_len - i - 64, b + b_len - i - 64, 64) == 0) i += 64;
+    while (i < len && a[a_len - i - 1] == b[b_len - i - 1]) i++;
+    return i;
+}
+
+/*
+ * Brings the adventure up to date with a new version of its source.
+ * When every changed byte falls inside a run of section objects, only
+ * those sections are parsed again; otherwise the whole file is.
+ * On success, the adventure takes ownership of source.
+ */
+enum WatchResult reload_source(WatchedAdventure *wa, char *source, size_t len) {
+    char *old = wa->source;
+    size_t const old_len = wa->source_len;
+    size_t const min_len = old_len < len ? old_len : len;
+    size_t const prefix = common_prefix(old, source, min_len);
+    size_t const suffix = common_suffix(old, old_len, source, len, min_len - prefix);
+
+    if (prefix == old_len && old_len == len) {
+        free(source);
+        return WATCH_UNCHANGED;
+    }
+
+    // changed bytes are [prefix, change_end) in the old source:
+    // they're in sections first to last, found by binary search
+    size_t const change_end = old_len - suffix;
+    size_t const n = wa->adv.section_count;
+    size_t lo = 0, hi = n;
+
+    while (lo < hi) {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (watch_span(wa, mid).end <= prefix) lo = mid + 1; else hi = mid;
+    }
+    size_t const first = lo;
+
+    lo = first + 1;
+    hi = n;
+    while (lo < hi) {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (watch_span(wa, mid).begin < change_end) lo = mid + 1; else hi = mid;
+    }
+    size_t const last = lo - 1;
+
+    enum WatchResult result = WATCH_ERROR;
+    if (first < n && watch_span(wa, first).begin <= prefix && change_end <= watch_span(wa, last).end) {
+        result = patch_sections(
+            wa, source, first, last,
+            watch_span(wa, first).begin, watch_span(wa, last).end + len - old_len
+        );
+    }
+
+    if (result == WATCH_ERROR) {
+        result = full_reload(wa, source, len);
+    }
+
+    if (result == WATCH_ERROR) {
+        free(source);
+    } else {
+        free(wa->source);
+        wa->source = source;
+        wa->source_len = len;
+    }
+
+    return result;
+}
+
+/*
+ * Loads an adventure and starts watching its file for changes.
+ * The file's directory is watched, so editors that replace the file
+ * on save are noticed too.
+ */
+bool watch_adventure(WatchedAdventure *wa, char *filename) {
+    *wa = (WatchedAdventure){ .fd = -1 };
+
+    wa->source = read_file(filename, &wa->source_len);
+    if (wa->source == NULL) {
+        return false;
+    }
+
+    if (full_reload(wa, wa->source, wa->source_len) == WATCH_ERROR) {
+        free(wa->source);
+        wa->source = NULL;
+        return false;
+    }
+
+    wa->filename = strdup(filename);
+    char *d = strdup(filename), *b = strdup(filename);
+    wa->dirname = strdup(dirname(d));
+    wa->basename = strdup(basename(b));
+    free(d);
+    free(b);
+
+    wa->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (wa->fd >= 0) {
+        inotify_add_watch(wa->fd, wa->dirname, IN_CLOSE_WRITE | IN_MOVED_TO);
+    }
+
+    return true;
+}
+
+/*
+ * Reads pending inotify events and reloads the adventure
+ * if its file was written.
+ */
+enum WatchResult watch_update(WatchedAdventure *wa) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+
+    while ((len = read(wa->fd, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + len;) {
+            struct inotify_event *e = (struct inotify_event *)p;
+
+            if (e->len > 0 && strcmp(e->name, wa->basename) == 0) {
+                changed = true;
+            }
+            p += sizeof(struct inotify_event) + e->len;
+        }
+    }
+
+    if (!changed) {
+        return WATCH_UNCHANGED;
+    }
+
+    size_t source_len;
+    char *source = read_file(wa->filename, &source_len);
+    if (source == NULL) {
+        return WATCH_ERROR;
+    }
+
+    return reload_source(wa, source, source_len);
+}
+
+/*
+ * Stops watching and frees the adventure.
+ */
+void unwatch_adventure(WatchedAdventure *wa) {
+    if (wa->fd >= 0) close(wa->fd);
+
+    free_adventure(&wa->adv);
+    free_patch_pools(wa);
+    free(wa->spans);
+    free(wa->shifts);
+    free(wa->source);
+    free(wa->filename);
+    free(wa->dirname);
+    free(wa->basename);
+}
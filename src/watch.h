@@ -0,0 +1,48 @@
+#ifndef TEXT_ADVENTURES_WATCH
+#define TEXT_ADVENTURES_WATCH
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "parse.h"
+
+typedef struct SourceSpan {
+    size_t begin, end; // byte range of a section in the source file
+} SourceSpan;
+
+typedef struct PatchPool {
+    Option *options;        // spilled options of some patched sections
+    size_t size;
+    size_t users;           // sections whose options are still in it
+} PatchPool;
+
+typedef struct WatchedAdventure {
+    Adventure adv;
+    char *filename;
+    char *dirname;
+    char *basename;
+    int fd;                 // inotify descriptor, poll it for changes
+    char *source;           // contents adv was parsed from
+    size_t source_len;
+    SourceSpan *spans;      // one per section, where it was last parsed
+    ptrdiff_t *shifts;      // how far sections moved since, see span_at
+    size_t option_pool_users; // sections whose options are in adv.option_pool
+    size_t pool_count;      // option pools of patched sections
+    PatchPool *pools;
+    size_t string_bytes;    // adv.strings->bytes when it was last compacted
+} WatchedAdventure;
+
+enum WatchResult {
+    WATCH_UNCHANGED,
+    WATCH_PATCHED,  // only the edited sections were parsed again
+    WATCH_RELOADED, // the whole file was parsed again
+    WATCH_ERROR,    // the file can't be read or parsed, adv is unchanged
+};
+
+bool watch_adventure(WatchedAdventure *wa, char *filename);
+enum WatchResult watch_update(WatchedAdventure *wa);
+enum WatchResult reload_source(WatchedAdventure *wa, char *source, size_t len);
+SourceSpan watch_span(WatchedAdventure *wa, size_t i);
+void unwatch_adventure(WatchedAdventure *wa);
+
+#endif // TEXT_ADVENTURES_WATCH
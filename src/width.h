@@ -0,0 +1,14 @@
+#ifndef TEXT_ADVENTURES_WIDTH
+#define TEXT_ADVENTURES_WIDTH
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void width_init(void);
+int char_width(uint32_t cp);
+size_t char_size(const char *s);
+bool char_is_blank(const char *s);
+size_t next_grapheme(const char *s, size_t *width);
+
+#endif // TEXT_ADVENTURES_WIDTH
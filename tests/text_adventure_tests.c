@@ -1,9 +1,35 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include "unity/unity.h"
 #include "../src/parse.h"
+#include "../src/hint.h"
+#include "../src/watch.h"
+#include "../src/catalog.h"
+#include "../src/compress.h"
+#include "../src/render.h"
+#include "../src/layout.h"
+#include "../src/width.h"
+#include "../src/input.h"
+#include "../src/adventure.h"
+#include "../src/save.h"
+#include "../src/store.h"
+#include "../src/framecache.h"
+#include "../src/graph.h"
+#include "../src/simulate.h"
+#include "../src/endings.h"
+#include "../src/paths.h"
+#include "../src/server.h"
 
 FILE *stream;
 char *buffer;
@@ -56,6 +82,16 @@ static void construct_file_like_obj(char *s) {
 }
 
 
+static Adventure load_adventure(char *filename) {
+    FILE *f = fopen(filename, "r");
+    Adventure adv = json_to_adventure(json_parse(f));
+    fclose(f);
+
+    TEST_ASSERT_NO_ERROR();
+    return adv;
+}
+
+
 // JSON parse tests
 static void compare_lists(List *expected, List *actual);
 
@@ -119,7 +155,7 @@ static void compare_section(Section expected, Section actual) {
     TEST_ASSERT_EQUAL(expected.option_count, actual.option_count);
 
     for (size_t i = 0; i < expected.option_count; ++i) {
-        compare_option(expected.options[i], actual.options[i]);
+        compare_option(section_options(&expected)[i], section_options(&actual)[i]);
     }
 }
 
@@ -585,7 +621,6 @@ static void test_convert_small_adventure(void) {
             .text = "This is the first and only section.",
             .id = 0,
             .option_count = 0,
-            .options = NULL
         }
     };
 
@@ -611,28 +646,24 @@ static void test_convert_not_so_small_adventure(void) {
         .text = "back to where we started",
     };
 
-    Option s0[] = {o1, o2};
-    Option s1[] = {o3, o2};
-    Option s2[] = {o3, o1};
-
     Section s[] = {
         (Section){
             .id = 0,
             .text = "This is the first and only section.",
             .option_count = 2,
-            .options = s0
+            .inline_options = {o1, o2}
         },
         (Section){
             .id = 1,
             .text = "This is section A.",
             .option_count = 2,
-            .options = s1
+            .inline_options = {o3, o2}
         },
         (Section){
             .id = 2,
             .text = "This is section B.",
             .option_count = 2,
-            .options = s2
+            .inline_options = {o3, o1}
         },
     };
     Adventure expected = (Adventure){
@@ -707,6 +738,21 @@ static void test_convert_adventure_missing_version(void) {
     TEST_ASSERT_ERROR(PE_MISSING_KEY);
 }
 
+static void test_load_adventure_file_keeps_json_error(void) {
+    char filename[64];
+    sprintf(filename, "/tmp/adv-test-broken-%d.json", (int)getpid());
+    FILE *f = fopen(filename, "w");
+    fputs("{\"title\": \"x\", \"author\": 3", f);
+    fclose(f);
+
+    Adventure adv;
+    TEST_ASSERT_FALSE(load_adventure_file(filename, &adv));
+    TEST_ASSERT_ERROR(PE_MISSING_BRACKET);
+    unlink(filename);
+
+    TEST_ASSERT_FALSE(load_adventure_file(filename, &adv));
+}
+
 static void test_convert_adventure_missing_sections(void) {
     construct_file_like_obj("{\"title\":\"\",\"author\":\"\",\"version\":\"\"}");
 
@@ -755,6 +801,1454 @@ static void test_convert_adventure_option_missing_text(void) {
     TEST_ASSERT_ERROR(PE_MISSING_KEY);
 }
 
+static void test_convert_adventure_with_many_options(void) {
+    stream = fopen("tests/test_file_many_options.json", "r");
+
+    Adventure actual = json_to_adventure(json_parse(stream));
+
+    TEST_ASSERT_NO_ERROR();
+    TEST_ASSERT_EQUAL(12, actual.sections[0].option_count);
+    TEST_ASSERT_EQUAL(12, actual.option_pool_size);
+    TEST_ASSERT_EQUAL_PTR(actual.option_pool, section_options(&actual.sections[0]));
+    TEST_ASSERT_EQUAL_STRING("go to 1", section_options(&actual.sections[0])[0].text);
+    TEST_ASSERT_EQUAL_STRING("go to 12", section_options(&actual.sections[0])[11].text);
+    TEST_ASSERT_EQUAL(12, section_options(&actual.sections[0])[11].section_id);
+
+    // small sections keep their options inline
+    TEST_ASSERT_EQUAL_PTR(actual.sections[1].inline_options, section_options(&actual.sections[1]));
+}
+
+static void test_convert_adventure_too_many_options(void) {
+    char json[20000] = "{\"title\":\"\",\"author\":\"\",\"version\":\"\",\"sections\":[{\"id\":0,\"text\":\"\",\"options\":[";
+
+    for (size_t i = 0; i <= MAX_OPTION_COUNT; ++i) {
+        strcat(json, i == 0 ? "{\"id\":0,\"text\":\"\"}" : ",{\"id\":0,\"text\":\"\"}");
+    }
+    strcat(json, "]}]}");
+    construct_file_like_obj(json);
+
+    json_to_adventure(json_parse(stream));
+
+    TEST_ASSERT_ERROR(PE_TOO_MANY_OPTIONS);
+}
+
+// String pool tests
+static void test_repeated_text_is_shared(void) {
+    stream = fopen("tests/test_file_with_multiple_sections.json", "r");
+
+    Adventure adv = json_to_adventure(json_parse(stream));
+
+    TEST_ASSERT_NO_ERROR();
+    TEST_ASSERT_EQUAL_PTR(section_options(&adv.sections[0])[1].text, section_options(&adv.sections[1])[1].text);
+    TEST_ASSERT_EQUAL_PTR(section_options(&adv.sections[1])[0].text, section_options(&adv.sections[2])[0].text);
+    TEST_ASSERT_EQUAL(9, adv.strings->strings);
+    TEST_ASSERT_EQUAL(6, adv.strings->unique);
+    TEST_ASSERT_EQUAL(
+        strlen("to section A!") + strlen("to section B!") + strlen("back to where we started") + 3,
+        adv.strings->saved_bytes
+    );
+
+    free_adventure(&adv);
+}
+
+static void test_intern_string(void) {
+    StringPool *p = new_string_pool();
+    char *a = intern_string(p, strdup("Go back"));
+    char *b = intern_string(p, strdup("Continue"));
+
+    for (int i = 0; i < 1000; ++i) {
+        char s[20];
+        sprintf(s, "string %d", i);
+        intern_string(p, strdup(s));
+    }
+
+    TEST_ASSERT_EQUAL_PTR(a, intern_string(p, strdup("Go back")));
+    TEST_ASSERT_EQUAL_PTR(b, intern_string(p, strdup("Continue")));
+    TEST_ASSERT_EQUAL_STRING("Go back", a);
+    TEST_ASSERT_EQUAL(1002, p->unique);
+
+    free_string_pool(p);
+}
+
+// Compressed text tests
+static void test_compressed_text_round_trip(void) {
+    Adventure plain = load_adventure("tests/test_file_bigger_adventure.json");
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+
+    compress_adventure(&adv);
+
+    TEST_ASSERT_NOT_NULL(adv.codec);
+    for (size_t i = 0; i < adv.section_count; ++i) {
+        TEST_ASSERT_EQUAL_STRING(plain.sections[i].text, section_text(&adv, &adv.sections[i]));
+        TEST_ASSERT_EQUAL_STRING(
+            section_options(&plain.sections[i])[0].text,
+            section_options(&adv.sections[i])[0].text
+        );
+    }
+    TEST_ASSERT_TRUE(adv.codec->compressed_bytes < adv.codec->plain_bytes);
+
+    free_adventure(&plain);
+    free_adventure(&adv);
+}
+
+static void test_compressed_utf8_text(void) {
+    construct_file_like_obj(
+        "{\"title\":\"\",\"author\":\"\",\"version\":\"\",\"sections\":["
+        "{\"id\":0,\"text\":\"\u00e1rbol, ni\u00f1o y \u4e16\u754c\",\"options\":[]},"
+        "{\"id\":1,\"text\":\"\",\"options\":[]}]}"
+    );
+
+    Adventure adv = json_to_adventure(json_parse(stream));
+    TEST_ASSERT_NO_ERROR();
+
+    compress_adventure(&adv);
+
+    TEST_ASSERT_EQUAL_STRING("\u00e1rbol, ni\u00f1o y \u4e16\u754c", section_text(&adv, &adv.sections[0]));
+    TEST_ASSERT_EQUAL_STRING("", section_text(&adv, &adv.sections[1]));
+
+    free_adventure(&adv);
+}
+
+// Frame tests
+static void test_frame_is_written_once(void) {
+    Frame f = (Frame){};
+    int fds[2];
+    char out[100] = {0};
+
+    TEST_ASSERT_EQUAL(0, pipe(fds));
+
+    frame_putc(&f, '|');
+    frame_pad(&f, ' ', 3);
+    TEST_ASSERT_EQUAL(3, frame_printf(&f, "%zu) ", (size_t)1));
+    frame_puts(&f, "text");
+    frame_flush(&f, fds[1]);
+    frame_flush(&f, fds[1]); // nothing left, no write
+
+    TEST_ASSERT_EQUAL(11, read(fds[0], out, sizeof(out)));
+    TEST_ASSERT_EQUAL_STRING("|   1) text", out);
+    TEST_ASSERT_EQUAL(1, f.frames);
+    TEST_ASSERT_EQUAL(1, f.writes);
+    TEST_ASSERT_EQUAL(11, f.bytes);
+
+    close(fds[0]);
+    close(fds[1]);
+    free_frame(&f);
+}
+
+static void test_frame_discard(void) {
+    Frame f = (Frame){};
+
+    frame_puts(&f, "headless");
+    frame_discard(&f);
+    frame_discard(&f);
+
+    TEST_ASSERT_EQUAL(0, f.len);
+    TEST_ASSERT_EQUAL(1, f.frames);
+    TEST_ASSERT_EQUAL(0, f.writes);
+    TEST_ASSERT_EQUAL(8, f.bytes);
+
+    free_frame(&f);
+}
+
+// Layout tests
+static void assert_line(Line expected, Line actual) {
+    TEST_ASSERT_EQUAL(expected.begin, actual.begin);
+    TEST_ASSERT_EQUAL(expected.end, actual.end);
+    TEST_ASSERT_EQUAL(expected.width, actual.width);
+    TEST_ASSERT_EQUAL(expected.verbatim, actual.verbatim);
+}
+
+static void test_layout_wraps_full_words(void) {
+    Layout l = layout_text("aaa bbb ccc", 0, 0, 8);
+
+    TEST_ASSERT_EQUAL(2, l.line_count);
+    assert_line((Line){ .begin = 0, .end = 7, .width = 7, .verbatim = true }, l.lines[0]);
+    assert_line((Line){ .begin = 8, .end = 11, .width = 3, .verbatim = true }, l.lines[1]);
+
+    free_layout(&l);
+}
+
+static void test_layout_breaks_on_newline(void) {
+    Layout l = layout_text("ab\ncd\tef", 2, 0, 20);
+
+    TEST_ASSERT_EQUAL(2, l.line_count);
+    assert_line((Line){ .begin = 0, .end = 2, .width = 2, .verbatim = true }, l.lines[0]);
+    assert_line((Line){ .begin = 3, .end = 8, .width = 5, .verbatim = false }, l.lines[1]);
+
+    free_layout(&l);
+}
+
+static void test_layout_breaks_long_words(void) {
+    char text[256] = "ab ";
+    memset(text + 3, 'x', 250);
+    Layout l = layout_text(text, 0, 0, 11);
+
+    TEST_ASSERT_EQUAL(26, l.line_count);
+    assert_line((Line){ .begin = 0, .end = 10, .width = 10, .verbatim = true }, l.lines[0]);
+    assert_line((Line){ .begin = 10, .end = 20, .width = 10, .verbatim = true }, l.lines[1]);
+    assert_line((Line){ .begin = 250, .end = 253, .width = 3, .verbatim = true }, l.lines[25]);
+
+    free_layout(&l);
+}
+
+static void test_char_width(void) {
+    width_init();
+
+    TEST_ASSERT_EQUAL(1, char_width('a'));
+    TEST_ASSERT_EQUAL(1, char_width(0xe9));    // é
+    TEST_ASSERT_EQUAL(2, char_width(0x65e5));  // 日
+    TEST_ASSERT_EQUAL(2, char_width(0xff21));  // fullwidth A
+    TEST_ASSERT_EQUAL(2, char_width(0x1f600)); // emoji
+    TEST_ASSERT_EQUAL(0, char_width(0x301));   // combining acute
+    TEST_ASSERT_EQUAL(0, char_width(0x200d));  // zero width joiner
+    TEST_ASSERT_EQUAL(2, char_width(0x31350)); // CJK Extension H
+    TEST_ASSERT_EQUAL(2, char_width(0x2ebf0)); // CJK Extension I
+    TEST_ASSERT_EQUAL(1, char_width(0x1d000)); // Byzantine musical symbol
+    TEST_ASSERT_EQUAL(0, char_width(0xe0101)); // variation selector 18
+}
+
+static void test_graphemes(void) {
+    size_t width;
+    width_init();
+
+    TEST_ASSERT_EQUAL(3, next_grapheme("e\xcc\x81x", &width)); // e + combining acute
+    TEST_ASSERT_EQUAL(1, width);
+    TEST_ASSERT_EQUAL(8, next_grapheme("\xf0\x9f\x87\xaf\xf0\x9f\x87\xb5", &width)); // flag
+    TEST_ASSERT_EQUAL(2, width);
+    TEST_ASSERT_EQUAL(11, next_grapheme("\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9 ", &width)); // ZWJ
+    TEST_ASSERT_EQUAL(2, width);
+}
+
+static void test_layout_wide_text(void) {
+    // 日本語のテキスト
+    Layout l = layout_text("\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae"
+                           "\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88", 0, 0, 8);
+
+    TEST_ASSERT_EQUAL(3, l.line_count);
+    assert_line((Line){ .begin = 0, .end = 9, .width = 6, .verbatim = true }, l.lines[0]);
+    assert_line((Line){ .begin = 9, .end = 18, .width = 6, .verbatim = true }, l.lines[1]);
+    assert_line((Line){ .begin = 18, .end = 24, .width = 4, .verbatim = true }, l.lines[2]);
+
+    free_layout(&l);
+}
+
+static void test_layout_cache(void) {
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    LayoutCache c;
+    layout_cache_init(&c, adv.section_count);
+
+    SectionLayout *l80 = layout_section(&c, &adv, &adv.sections[0], 80);
+    TEST_ASSERT_EQUAL(2, l80->option_count);
+    TEST_ASSERT_EQUAL_PTR(l80, layout_section(&c, &adv, &adv.sections[0], 80));
+    TEST_ASSERT_EQUAL(1, c.hits);
+    TEST_ASSERT_EQUAL(1, c.misses);
+
+    SectionLayout *l40 = layout_section(&c, &adv, &adv.sections[0], 40);
+    TEST_ASSERT_TRUE(l40->text.line_count > l80->text.line_count);
+    TEST_ASSERT_EQUAL(2, c.misses);
+
+    // sections never shown take no entries
+    TEST_ASSERT_NULL(c.entries[1]);
+
+    layout_cache_clear(&c);
+    TEST_ASSERT_NULL(c.entries[0]);
+    layout_section(&c, &adv, &adv.sections[0], 80);
+    TEST_ASSERT_EQUAL(3, c.misses);
+
+    free_layout_cache(&c);
+    free_adventure(&adv);
+}
+
+// Input tests
+static void assert_key(enum KeyType type, uint32_t cp, Input *in) {
+    Key key;
+    TEST_ASSERT_EQUAL(INPUT_KEY, input_key(in, &key, false));
+    TEST_ASSERT_EQUAL(type, key.type);
+    if (type == KEY_CHAR || type == KEY_ALT) TEST_ASSERT_EQUAL(cp, key.cp);
+}
+
+static void test_input_decodes_keys(void) {
+    int fds[2];
+    pipe(fds);
+    write(fds[1], "q\x1b[A\x1bOD\x1b[3~12\r\n\x7f\xc3\xa9\x1bq\x1b\xc3\xa9\x1b\x1b[B\x1b\r", 29);
+
+    Input in;
+    input_init(&in, fds[0]);
+    TEST_ASSERT_TRUE(input_fill(&in));
+
+    assert_key(KEY_CHAR, 'q', &in);
+    assert_key(KEY_UP, 0, &in);
+    assert_key(KEY_LEFT, 0, &in);
+    assert_key(KEY_DELETE, 0, &in);
+    assert_key(KEY_CHAR, '1', &in);
+    assert_key(KEY_CHAR, '2', &in);
+    assert_key(KEY_ENTER, 0, &in);
+    assert_key(KEY_BACKSPACE, 0, &in);
+    assert_key(KEY_CHAR, 0xe9, &in);
+    assert_key(KEY_ALT, 'q', &in); // Alt-q, not escape and quit
+    assert_key(KEY_ALT, 0xe9, &in);
+    assert_key(KEY_ESCAPE, 0, &in);
+    assert_key(KEY_DOWN, 0, &in);
+    assert_key(KEY_UNKNOWN, 0, &in);
+
+    Key key;
+    TEST_ASSERT_EQUAL(INPUT_AGAIN, input_key(&in, &key, false));
+    close(fds[1]);
+    TEST_ASSERT_FALSE(input_fill(&in));
+    TEST_ASSERT_EQUAL(INPUT_EOF, input_key(&in, &key, false));
+    close(fds[0]);
+}
+
+static void test_input_waits_for_partial_keys(void) {
+    Input in;
+    Key key;
+    input_init(&in, -1);
+
+    input_feed(&in, "\x1b", 1);
+    TEST_ASSERT_EQUAL(INPUT_AGAIN, input_key(&in, &key, false));
+    TEST_ASSERT_TRUE(input_pending(&in));
+    TEST_ASSERT_EQUAL(INPUT_KEY, input_key(&in, &key, true));
+    TEST_ASSERT_EQUAL(KEY_ESCAPE, key.type);
+
+    input_feed(&in, "\x1b[", 2);
+    TEST_ASSERT_EQUAL(INPUT_AGAIN, input_key(&in, &key, false));
+    input_feed(&in, "B\xe6\x97", 3);
+    assert_key(KEY_DOWN, 0, &in);
+    TEST_ASSERT_EQUAL(INPUT_AGAIN, input_key(&in, &key, false));
+    input_feed(&in, "\xa5", 1);
+    assert_key(KEY_CHAR, 0x65e5, &in);
+    TEST_ASSERT_FALSE(input_pending(&in));
+
+    input_feed(&in, "\x1b\xc3", 2);
+    TEST_ASSERT_EQUAL(INPUT_AGAIN, input_key(&in, &key, false));
+    input_feed(&in, "\xa9", 1);
+    assert_key(KEY_ALT, 0xe9, &in);
+    TEST_ASSERT_FALSE(input_pending(&in));
+
+    // an escape sequence longer than the buffer never ends: it's dropped
+    char csi[INPUT_BUFFER_SIZE + 2] = "\x1b[";
+    memset(csi + 2, '1', INPUT_BUFFER_SIZE);
+    input_feed(&in, csi, sizeof(csi));
+    assert_key(KEY_UNKNOWN, 0x1b, &in);
+    TEST_ASSERT_FALSE(input_pending(&in));
+}
+
+// Step by step play tests
+static Key char_key(char c) {
+    return (Key){ .type = KEY_CHAR, .cp = c };
+}
+
+static void test_session_steps_through_sections(void) {
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    Session s;
+    Frame out = (Frame){};
+    LayoutCache layouts;
+
+    layout_cache_init(&layouts, adv.section_count);
+    session_init(&s, &adv, &layouts, 40);
+
+    TEST_ASSERT_EQUAL(TRANSITION_NONE, session_feed(&s, char_key('1'))); // nothing shown yet
+    TEST_ASSERT_TRUE(session_render(&s, &out));
+    TEST_ASSERT_EQUAL(TRANSITION_NONE, session_feed(&s, char_key('7')));
+    TEST_ASSERT_EQUAL(TRANSITION_HINT, session_feed(&s, char_key('h')));
+    TEST_ASSERT_EQUAL(TRANSITION_MOVED, session_feed(&s, char_key('1')));
+    TEST_ASSERT_EQUAL(1, adv.sections[s.section].id);
+
+    out.len = 0;
+    TEST_ASSERT_TRUE(session_render(&s, &out));
+    frame_putc(&out, 0);
+    TEST_ASSERT_NOT_NULL(strstr(out.data, "Hint: option"));
+    TEST_ASSERT_NOT_NULL(strstr(out.data, "only option"));
+
+    TEST_ASSERT_EQUAL(TRANSITION_QUIT, session_feed(&s, char_key('q')));
+    TEST_ASSERT_FALSE(session_render(&s, &out));
+
+    free_frame(&out);
+    free_session(&s);
+    free_layout_cache(&layouts);
+    free_adventure(&adv);
+}
+
+static void test_sessions_render_independently(void) {
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    Session narrow, wide;
+    Frame a = (Frame){}, b = (Frame){};
+    LayoutCache narrow_layouts, wide_layouts;
+
+    layout_cache_init(&narrow_layouts, adv.section_count);
+    layout_cache_init(&wide_layouts, adv.section_count);
+    session_init(&narrow, &adv, &narrow_layouts, 30);
+    session_init(&wide, &adv, &wide_layouts, 60);
+
+    TEST_ASSERT_TRUE(session_render(&narrow, &a));
+    TEST_ASSERT_TRUE(session_render(&wide, &b));
+    TEST_ASSERT_EQUAL(TRANSITION_MOVED, session_feed(&narrow, char_key('1')));
+    TEST_ASSERT_EQUAL(0, wide.section);
+
+    // wide hasn't been asked anything since, its first frame stays as it was
+    a.len = 0;
+    TEST_ASSERT_TRUE(session_render(&narrow, &a));
+    frame_putc(&a, 0);
+    frame_putc(&b, 0);
+
+    // each frame is laid out to its own session's width
+    char row[32] = " |";
+    memset(row + 2, ' ', 26);
+    strcpy(row + 28, "|\n");
+    TEST_ASSERT_NOT_NULL(strstr(a.data, row));
+    TEST_ASSERT_NULL(strstr(b.data, row));
+    TEST_ASSERT_NOT_NULL(strstr(a.data, "selected this option!    |"));
+
+    free_frame(&a);
+    free_frame(&b);
+    free_session(&narrow);
+    free_session(&wide);
+    free_layout_cache(&narrow_layouts);
+    free_layout_cache(&wide_layouts);
+    free_adventure(&adv);
+}
+
+// Save tests
+static void test_save_restores_session(void) {
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    LayoutCache layouts;
+    Session s, restored;
+    Frame out = (Frame){};
+    uint8_t save[64];
+
+    layout_cache_init(&layouts, adv.section_count);
+    session_init(&s, &adv, &layouts, 40);
+    session_render(&s, &out);
+    TEST_ASSERT_EQUAL(TRANSITION_MOVED, session_feed(&s, char_key('1')));
+
+    size_t const len = save_session(&s, save, sizeof(save));
+    TEST_ASSERT_EQUAL(sizeof(SaveHeader) + 1, len);
+
+    session_init(&restored, &adv, &layouts, 40);
+    TEST_ASSERT_EQUAL(SAVE_OK, restore_session(&restored, save, len));
+    TEST_ASSERT_EQUAL(s.section, restored.section);
+    TEST_ASSERT_EQUAL(1, restored.history_len);
+    TEST_ASSERT_EQUAL(0, restored.history[0]);
+
+    free_frame(&out);
+    free_session(&s);
+    free_session(&restored);
+    free_layout_cache(&layouts);
+    free_adventure(&adv);
+}
+
+static void test_save_forgets_old_history(void) {
+    Adventure adv = load_adventure("tests/test_file_with_multiple_sections.json");
+    LayoutCache layouts;
+    Session s, restored;
+    Frame out = (Frame){};
+    char filename[64];
+
+    // back and forth between the first section and A, for ever
+    layout_cache_init(&layouts, adv.section_count);
+    session_init(&s, &adv, &layouts, 40);
+    for (uint32_t i = 0; i <= SESSION_HISTORY; ++i) {
+        out.len = 0;
+        session_render(&s, &out);
+        TEST_ASSERT_EQUAL(TRANSITION_MOVED, session_feed(&s, char_key('1')));
+    }
+    TEST_ASSERT_EQUAL(SESSION_HISTORY / 2 + 1, s.history_len);
+    TEST_ASSERT_EQUAL(&adv.sections[s.origin], find_section(&adv, 0));
+    TEST_ASSERT_EQUAL(&adv.sections[s.section], find_section(&adv, 1));
+
+    snprintf(filename, sizeof(filename), "/tmp/adv-test-save-%d", (int)getpid());
+    TEST_ASSERT_TRUE(save_session_file(&s, filename));
+    session_init(&restored, &adv, &layouts, 40);
+    TEST_ASSERT_EQUAL(SAVE_OK, restore_session_file(&restored, filename));
+    TEST_ASSERT_EQUAL(s.section, restored.section);
+    unlink(filename);
+
+    // a save with more history than a session keeps
+    size_t const len = sizeof(SaveHeader) + SESSION_HISTORY + 1;
+    uint8_t *long_save = malloc(len);
+    save_session(&s, long_save, len);
+    ((SaveHeader *)long_save)->origin = s.origin;
+    ((SaveHeader *)long_save)->history_len = SESSION_HISTORY + 1;
+    memset(long_save + sizeof(SaveHeader), s.history[0], SESSION_HISTORY + 1);
+    free_session(&restored);
+    session_init(&restored, &adv, &layouts, 40);
+    TEST_ASSERT_EQUAL(SAVE_CORRUPT, restore_session(&restored, long_save, len));
+    free(long_save);
+
+    free_frame(&out);
+    free_session(&s);
+    free_session(&restored);
+    free_layout_cache(&layouts);
+    free_adventure(&adv);
+}
+
+static void test_save_rejects_bad_saves(void) {
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    LayoutCache layouts;
+    Session s;
+    Frame out = (Frame){};
+    uint8_t save[64], bad[64];
+
+    layout_cache_init(&layouts, adv.section_count);
+    session_init(&s, &adv, &layouts, 40);
+    session_render(&s, &out);
+    session_feed(&s, char_key('1'));
+    size_t const len = save_session(&s, save, sizeof(save));
+    free_session(&s);
+    session_init(&s, &adv, &layouts, 40);
+
+    TEST_ASSERT_EQUAL(SAVE_NOT_A_SAVE, restore_session(&s, save, len - 1));
+
+    memcpy(bad, save, len);
+    bad[0] = 'X';
+    TEST_ASSERT_EQUAL(SAVE_NOT_A_SAVE, restore_session(&s, bad, len));
+
+    memcpy(bad, save, len);
+    ((SaveHeader *)bad)->content_hash ^= 1;
+    TEST_ASSERT_EQUAL(SAVE_OTHER_ADVENTURE, restore_session(&s, bad, len));
+
+    memcpy(bad, save, len);
+    bad[len - 1] = 7; // no such option
+    TEST_ASSERT_EQUAL(SAVE_CORRUPT, restore_session(&s, bad, len));
+
+    memcpy(bad, save, len);
+    ((SaveHeader *)bad)->section = 0; // the history leads elsewhere
+    TEST_ASSERT_EQUAL(SAVE_CORRUPT, restore_session(&s, bad, len));
+    TEST_ASSERT_EQUAL(0, s.section);
+
+    // another adventure hashes differently
+    Adventure other = load_adventure("tests/test_file_with_multiple_sections.json");
+    TEST_ASSERT_NOT_EQUAL(adv.content_hash, other.content_hash);
+
+    free_frame(&out);
+    free_session(&s);
+    free_layout_cache(&layouts);
+    free_adventure(&other);
+    free_adventure(&adv);
+}
+
+// Hint tests
+static void test_hint_distances(void) {
+    stream = fopen("tests/test_file_bigger_adventure.json", "r");
+
+    Adventure adv = json_to_adventure(json_parse(stream));
+    TEST_ASSERT_NO_ERROR();
+
+    size_t option, distance;
+    uint32_t expected_distance[] = {2, 2, 1, 0, 0};
+
+    for (size_t i = 0; i < adv.section_count; ++i) {
+        TEST_ASSERT_EQUAL(expected_distance[i], adv.ending_distance[i]);
+    }
+
+    TEST_ASSERT_TRUE(adventure_hint(&adv, &adv.sections[0], &option, &distance));
+    TEST_ASSERT_EQUAL(1, option);
+    TEST_ASSERT_EQUAL(2, distance);
+
+    TEST_ASSERT_TRUE(adventure_hint(&adv, &adv.sections[2], &option, &distance));
+    TEST_ASSERT_EQUAL(0, option);
+    TEST_ASSERT_EQUAL(1, distance);
+}
+
+static void test_hint_on_ending(void) {
+    stream = fopen("tests/test_file_bigger_adventure.json", "r");
+
+    Adventure adv = json_to_adventure(json_parse(stream));
+    size_t option, distance;
+
+    TEST_ASSERT_NO_ERROR();
+    TEST_ASSERT_FALSE(adventure_hint(&adv, &adv.sections[3], &option, &distance));
+}
+
+static void test_hint_without_reachable_ending(void) {
+    stream = fopen("tests/test_file_with_multiple_sections.json", "r");
+
+    Adventure adv = json_to_adventure(json_parse(stream));
+    size_t option, distance;
+
+    TEST_ASSERT_NO_ERROR();
+    TEST_ASSERT_EQUAL(HINT_NO_ENDING, adv.ending_distance[0]);
+    TEST_ASSERT_FALSE(adventure_hint(&adv, &adv.sections[0], &option, &distance));
+}
+
+// Hot reload tests
+static char *replace_once(WatchedAdventure *wa, char *from, char *to, size_t *len) {
+    char *at = strstr(wa->source, from);
+    TEST_ASSERT_NOT_NULL(at);
+
+    size_t const before = at - wa->source;
+    *len = wa->source_len - strlen(from) + strlen(to);
+    char *out = malloc(*len + 1);
+
+    memcpy(out, wa->source, before);
+    memcpy(out + before, to, strlen(to));
+    memcpy(out + before + strlen(to), at + strlen(from), wa->source_len - before - strlen(from));
+    out[*len] = 0;
+    return out;
+}
+
+static void test_reload_patches_edited_section(void) {
+    WatchedAdventure wa;
+    size_t len;
+
+    TEST_ASSERT_TRUE(watch_adventure(&wa, "tests/test_file_bigger_adventure.json"));
+    wa.adv.current_section = &wa.adv.sections[4];
+
+    char *untouched = wa.adv.sections[3].text;
+    size_t const untouched_begin = watch_span(&wa, 3).begin;
+    char *source = replace_once(&wa, "The plott thickens.", "The plot thickens.", &len);
+
+    TEST_ASSERT_EQUAL(WATCH_PATCHED, reload_source(&wa, source, len));
+    TEST_ASSERT_EQUAL(5, wa.adv.section_count);
+    TEST_ASSERT_EQUAL_STRING(
+        "So, after getting here, the story experiences some inconveniences. The plot thickens.",
+        wa.adv.sections[2].text
+    );
+    TEST_ASSERT_EQUAL_PTR(untouched, wa.adv.sections[3].text);
+    TEST_ASSERT_EQUAL(untouched_begin - 1, watch_span(&wa, 3).begin);
+    TEST_ASSERT_EQUAL(4, wa.adv.current_section->id);
+    TEST_ASSERT_EQUAL('{', wa.source[watch_span(&wa, 3).begin]);
+    TEST_ASSERT_EQUAL('}', wa.source[watch_span(&wa, 3).end - 1]);
+
+    unwatch_adventure(&wa);
+}
+
+static void test_reload_rejects_window_closing_early(void) {
+    WatchedAdventure wa;
+    size_t len;
+
+    TEST_ASSERT_TRUE(watch_adventure(&wa, "tests/test_file_bigger_adventure.json"));
+    wa.adv.current_section = &wa.adv.sections[2];
+
+    // closes the sections and the adventure inside section 2
+    char *source = replace_once(&wa, "The plott thickens.\"", "x\", \"options\": []}]} \"", &len);
+
+    TEST_ASSERT_EQUAL(WATCH_ERROR, reload_source(&wa, source, len));
+    TEST_ASSERT_EQUAL(5, wa.adv.section_count);
+    TEST_ASSERT_EQUAL_STRING(
+        "So, after getting here, the story experiences some inconveniences. The plott thickens.",
+        wa.adv.sections[2].text
+    );
+
+    unwatch_adventure(&wa);
+}
+
+static void test_reload_outside_sections_parses_everything(void) {
+    WatchedAdventure wa;
+    size_t len;
+
+    TEST_ASSERT_TRUE(watch_adventure(&wa, "tests/test_file_bigger_adventure.json"));
+    wa.adv.current_section = &wa.adv.sections[2];
+
+    char *source = replace_once(&wa, "\"1.0\"", "\"1.1\"", &len);
+
+    TEST_ASSERT_EQUAL(WATCH_RELOADED, reload_source(&wa, source, len));
+    TEST_ASSERT_EQUAL_STRING("1.1", wa.adv.version);
+    TEST_ASSERT_EQUAL(2, wa.adv.current_section->id);
+
+    unwatch_adventure(&wa);
+}
+
+static void test_reload_frees_replaced_options(void) {
+    WatchedAdventure wa;
+    size_t len;
+
+    TEST_ASSERT_TRUE(watch_adventure(&wa, "tests/test_file_many_options.json"));
+    wa.adv.current_section = wa.adv.sections;
+    TEST_ASSERT_NOT_NULL(wa.adv.option_pool);
+
+    // the hub was the only section spilling its options
+    char *source = replace_once(&wa, "\"go to 12\"", "\"go to twelve\"", &len);
+    TEST_ASSERT_EQUAL(WATCH_PATCHED, reload_source(&wa, source, len));
+    TEST_ASSERT_NULL(wa.adv.option_pool);
+    TEST_ASSERT_EQUAL(1, wa.pool_count);
+
+    source = replace_once(&wa, "\"go to twelve\"", "\"go to the last room\"", &len);
+    TEST_ASSERT_EQUAL(WATCH_PATCHED, reload_source(&wa, source, len));
+    TEST_ASSERT_EQUAL(1, wa.pool_count);
+    TEST_ASSERT_EQUAL_STRING("go to the last room", section_options(&wa.adv.sections[0])[11].text);
+
+    // a new section moves the ones after it, and hashes like a fresh load
+    source = replace_once(&wa, "{\n            \"id\": 12,", "{\"id\": 13, \"text\": \"New.\", \"options\": []},{\n            \"id\": 12,", &len);
+    TEST_ASSERT_EQUAL(WATCH_PATCHED, reload_source(&wa, source, len));
+    TEST_ASSERT_EQUAL(14, wa.adv.section_count);
+    TEST_ASSERT_EQUAL_PTR(&wa.adv.sections[13], find_section(&wa.adv, 12));
+    TEST_ASSERT_EQUAL('{', wa.source[watch_span(&wa, 13).begin]);
+
+    FILE *f = fmemopen(wa.source, wa.source_len, "r");
+    Adventure fresh = json_to_adventure(json_parse(f));
+    fclose(f);
+    TEST_ASSERT_EQUAL(fresh.content_hash, wa.adv.content_hash);
+
+    free_adventure(&fresh);
+    unwatch_adventure(&wa);
+}
+
+static void test_reload_keeps_adventure_on_error(void) {
+    WatchedAdventure wa;
+    size_t len;
+
+    TEST_ASSERT_TRUE(watch_adventure(&wa, "tests/test_file_bigger_adventure.json"));
+    wa.adv.current_section = wa.adv.sections;
+
+    char *source = replace_once(&wa, "\"or not\"", "\"or not", &len);
+
+    TEST_ASSERT_EQUAL(WATCH_ERROR, reload_source(&wa, source, len));
+    TEST_ASSERT_EQUAL(5, wa.adv.section_count);
+    TEST_ASSERT_EQUAL_STRING("or not", section_options(&wa.adv.sections[2])[1].text);
+
+    unwatch_adventure(&wa);
+}
+
+// Shared catalog tests
+static void test_catalog_round_trip(void) {
+    char name[64];
+    sprintf(name, "/adv-test-%d", (int)getpid());
+    catalog_remove(name);
+
+    Adventure adv = load_adventure("tests/test_file_many_options.json");
+    Catalog c;
+
+    TEST_ASSERT_EQUAL(CATALOG_OK, catalog_publish(name, &adv, NULL));
+    TEST_ASSERT_EQUAL(CATALOG_EXISTS, catalog_publish(name, &adv, NULL));
+    TEST_ASSERT_TRUE(catalog_open(name, &c));
+    catalog_remove(name);
+
+    compare_adventures(adv, c.adv);
+    TEST_ASSERT_EQUAL_PTR(&c.adv.sections[3], find_section(&c.adv, 3));
+    TEST_ASSERT_EQUAL(adv.ending_distance[1], c.adv.ending_distance[1]);
+    TEST_ASSERT_EQUAL(adv.hint_option[0], c.adv.hint_option[0]);
+
+    catalog_close(&c);
+    free_adventure(&adv);
+}
+
+static void test_catalog_knows_its_source(void) {
+    char name[64];
+    sprintf(name, "/adv-test-source-%d", (int)getpid());
+    catalog_remove(name);
+
+    char *filename = "tests/test_file_many_options.json";
+    Adventure adv = load_adventure(filename);
+    struct stat source;
+    Catalog c;
+
+    TEST_ASSERT_EQUAL(0, stat(filename, &source));
+    TEST_ASSERT_EQUAL(CATALOG_OK, catalog_publish(name, &adv, &source));
+    TEST_ASSERT_TRUE(catalog_open(name, &c));
+
+    TEST_ASSERT_TRUE(catalog_from(&c, &source));
+    source.st_mtim.tv_nsec ^= 1;
+    TEST_ASSERT_FALSE(catalog_from(&c, &source));
+
+    // touched, not changed: the segment is told
+    TEST_ASSERT_TRUE(catalog_update_source(name, &c, &source));
+    catalog_close(&c);
+    TEST_ASSERT_TRUE(catalog_open(name, &c));
+    TEST_ASSERT_TRUE(catalog_from(&c, &source));
+    catalog_remove(name);
+
+    catalog_close(&c);
+    free_adventure(&adv);
+}
+
+static void test_catalog_dead_publisher(void) {
+    char name[64];
+    sprintf(name, "/adv-test-dead-%d", (int)getpid());
+    catalog_remove(name);
+
+    pid_t const child = fork();
+    if (child == 0) _exit(0);
+    waitpid(child, NULL, 0);
+
+    // a segment its publisher never finished
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL(0, ftruncate(fd, sizeof(CatalogHeader)));
+    CatalogHeader h = { .publisher = child };
+    TEST_ASSERT_EQUAL(sizeof(h), pwrite(fd, &h, sizeof(h), 0));
+    close(fd);
+
+    struct timespec start, end;
+    Catalog c;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TEST_ASSERT_FALSE(catalog_open(name, &c));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    catalog_remove(name);
+
+    TEST_ASSERT_TRUE(end.tv_sec - start.tv_sec < 2); // not the full wait
+}
+
+static void test_catalog_missing_segment(void) {
+    Catalog c;
+    TEST_ASSERT_FALSE(catalog_open("/adv-test-does-not-exist", &c));
+}
+
+// Session store tests
+static void test_store_keeps_sessions(void) {
+    char filename[64];
+    sprintf(filename, "/tmp/adv-test-store-%d", (int)getpid());
+    unlink(filename);
+
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    LayoutCache layouts;
+    SessionStore st;
+    Session s;
+    Frame out = (Frame){};
+
+    layout_cache_init(&layouts, adv.section_count);
+    TEST_ASSERT_EQUAL(STORE_OK, store_open(&st, filename, &adv));
+    uint64_t finished_token, playing_token, torn_token;
+    uint32_t const finished = store_add(&st, &finished_token);
+    uint32_t const playing = store_add(&st, &playing_token);
+    TEST_ASSERT_NOT_EQUAL(finished_token, playing_token);
+    TEST_ASSERT_NOT_EQUAL(finished, playing);
+
+    session_init(&s, &adv, &layouts, 40);
+    session_render(&s, &out);
+    session_feed(&s, char_key('1'));
+    store_put(&st, playing, &s);
+    store_release(&st, playing, true);
+    store_release(&st, finished, false);
+
+    // a record caught halfway through being written is dropped
+    uint32_t const torn = store_add(&st, &torn_token);
+    store_put(&st, torn, &s);
+    st.records[torn].section = 2;
+    store_release(&st, torn, true);
+    free_session(&s);
+
+    TEST_ASSERT_TRUE(store_checkpoint(&st) > 0);
+    TEST_ASSERT_EQUAL(0, store_checkpoint(&st)); // nothing changed since
+    store_close(&st);
+
+    TEST_ASSERT_EQUAL(STORE_OK, store_open(&st, filename, &adv));
+    TEST_ASSERT_EQUAL(1, st.resumable);
+
+    session_init(&s, &adv, &layouts, 40);
+    TEST_ASSERT_FALSE(store_resume(&st, finished, finished_token, &s));
+    TEST_ASSERT_FALSE(store_resume(&st, playing, finished_token, &s)); // someone else's
+    TEST_ASSERT_TRUE(store_resume(&st, playing, playing_token, &s));
+    TEST_ASSERT_FALSE(store_resume(&st, playing, playing_token, &s)); // already taken
+    TEST_ASSERT_FALSE(store_resume(&st, torn, torn_token, &s));
+    TEST_ASSERT_EQUAL(&adv.sections[s.section], find_section(&adv, 1));
+    TEST_ASSERT_EQUAL(1, s.history_len);
+
+    // records are checked again when they're resumed
+    store_release(&st, playing, true);
+    st.records[playing].history[0] = 1;
+    free_session(&s);
+    session_init(&s, &adv, &layouts, 40);
+    TEST_ASSERT_FALSE(store_resume(&st, playing, playing_token, &s));
+    store_close(&st);
+
+    // sessions of one adventure don't resume in another
+    Adventure other = load_adventure("tests/test_file_many_options.json");
+    TEST_ASSERT_EQUAL(STORE_OTHER_ADVENTURE, store_open(&st, filename, &other));
+
+    unlink(filename);
+    free_frame(&out);
+    free_session(&s);
+    free_layout_cache(&layouts);
+    free_adventure(&other);
+    free_adventure(&adv);
+}
+
+// Frame cache tests
+static CachedFrame *new_cached_frame(uint32_t section, size_t len) {
+    CachedFrame *f = malloc(sizeof(CachedFrame) + len);
+    *f = (CachedFrame){ .version = 1, .section = section, .width = 80, .len = len };
+    memset(f->data, 'x', len);
+    return f;
+}
+
+static void test_frame_cache_evicts_oldest(void) {
+    FrameCache c;
+    frame_cache_init(&c, 3 * (sizeof(CachedFrame) + 100));
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        frame_cache_release(&c, frame_cache_put(&c, new_cached_frame(i, 100)));
+    }
+    TEST_ASSERT_EQUAL(3, c.entries);
+
+    // 0 is used again, so 1 is the oldest now
+    CachedFrame *held = frame_cache_get(&c, 1, 0, 80, FRAME_OPENS_ROW);
+    TEST_ASSERT_NOT_NULL(held);
+    frame_cache_release(&c, frame_cache_put(&c, new_cached_frame(3, 100)));
+
+    TEST_ASSERT_EQUAL(1, c.evictions);
+    TEST_ASSERT_NULL(frame_cache_get(&c, 1, 1, 80, FRAME_OPENS_ROW));
+    TEST_ASSERT_NULL(frame_cache_get(&c, 1, 0, 120, FRAME_OPENS_ROW));
+    TEST_ASSERT_NULL(frame_cache_get(&c, 1, 0, 80, FRAME_CONTINUES_ROW));
+
+    // a frame that's held outlives its eviction
+    for (uint32_t i = 4; i < 8; ++i) {
+        frame_cache_release(&c, frame_cache_put(&c, new_cached_frame(i, 100)));
+    }
+    TEST_ASSERT_EQUAL('x', held->data[99]);
+    frame_cache_release(&c, held);
+
+    TEST_ASSERT_EQUAL(1, c.hits);
+    TEST_ASSERT_EQUAL(3, c.misses);
+    free_frame_cache(&c);
+}
+
+static void test_session_renders_through_frame_cache(void) {
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    LayoutCache layouts;
+    FrameCache frames;
+    Session plain, cached;
+    Frame a = (Frame){}, b = (Frame){};
+
+    layout_cache_init(&layouts, adv.section_count);
+    frame_cache_init(&frames, 1 << 20);
+
+    for (int run = 0; run < 2; ++run) {
+        session_init(&plain, &adv, &layouts, 40);
+        session_init(&cached, &adv, &layouts, 40);
+        cached.frames = &frames;
+
+        for (int step = 0; step < 3; ++step) {
+            session_render(&plain, &a);
+            session_render(&cached, &b);
+
+            CachedFrame *f = session_take_frame(&cached);
+            TEST_ASSERT_NOT_NULL(f);
+            frame_put(&b, f->data, f->len);
+            frame_cache_release(&frames, f);
+
+            session_feed(&plain, char_key('1'));
+            session_feed(&cached, char_key('1'));
+        }
+
+        free_session(&plain);
+        free_session(&cached);
+    }
+
+    TEST_ASSERT_EQUAL(a.len, b.len);
+    TEST_ASSERT_EQUAL_MEMORY(a.data, b.data, a.len);
+    TEST_ASSERT_EQUAL(3, frames.misses);
+    TEST_ASSERT_EQUAL(3, frames.hits);
+
+    free_frame(&a);
+    free_frame(&b);
+    free_frame_cache(&frames);
+    free_layout_cache(&layouts);
+    free_adventure(&adv);
+}
+
+// Choice log tests
+#define LOG_TEST_THREADS 8
+#define LOG_TEST_APPENDS 2000
+
+static void *append_choices(void *arg) {
+    ChoiceLog *log = arg;
+    uint32_t const session = choice_log_session(log);
+
+    for (uint32_t i = 0; i < LOG_TEST_APPENDS; ++i) {
+        choice_log_append(log, session, 0, 1, 0);
+    }
+    return NULL;
+}
+
+static void test_choice_log_appends_records(void) {
+    char filename[64];
+    sprintf(filename, "/tmp/adv-test-log-%d", (int)getpid());
+    unlink(filename);
+
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    ChoiceLog log;
+    pthread_t threads[LOG_TEST_THREADS];
+    size_t const count = LOG_TEST_THREADS * LOG_TEST_APPENDS;
+
+    // sessions on every thread share the syncs
+    TEST_ASSERT_EQUAL(CHOICE_LOG_OK, choice_log_open(&log, filename, &adv));
+    for (size_t i = 0; i < LOG_TEST_THREADS; ++i) {
+        pthread_create(&threads[i], NULL, append_choices, &log);
+    }
+    for (size_t i = 0; i < LOG_TEST_THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    TEST_ASSERT_TRUE(choice_log_sync(&log));
+    TEST_ASSERT_EQUAL(count, log.durable_count);
+    TEST_ASSERT_TRUE(log.commits < count / 10);
+    choice_log_close(&log);
+
+    // a record cut short is dropped when the log is opened again
+    FILE *f = fopen(filename, "ab");
+    fwrite("xx", 1, 2, f);
+    fclose(f);
+
+    // and sessions of this run don't take ids of the last one
+    TEST_ASSERT_EQUAL(CHOICE_LOG_OK, choice_log_open(&log, filename, &adv));
+    uint32_t const session = choice_log_session(&log);
+    TEST_ASSERT_EQUAL(LOG_TEST_THREADS, session);
+    choice_log_append(&log, session, 1, 2, 0);
+    choice_log_close(&log);
+
+    f = fopen(filename, "rb");
+    ChoiceLogHeader h;
+    ChoiceRecord *records = malloc(sizeof(ChoiceRecord) * (count + 1));
+    TEST_ASSERT_EQUAL(1, fread(&h, sizeof(h), 1, f));
+    TEST_ASSERT_EQUAL(count + 1, fread(records, sizeof(ChoiceRecord), count + 1, f));
+    fclose(f);
+
+    TEST_ASSERT_EQUAL(adv.content_hash, h.content_hash);
+    TEST_ASSERT_TRUE(records[count - 1].session < LOG_TEST_THREADS);
+    TEST_ASSERT_EQUAL(LOG_TEST_THREADS, records[count].session);
+    TEST_ASSERT_EQUAL(2, records[count].to);
+    TEST_ASSERT_TRUE(records[count].time >= records[0].time);
+    free(records);
+
+    Adventure other = load_adventure("tests/test_file_many_options.json");
+    TEST_ASSERT_EQUAL(CHOICE_LOG_OTHER_ADVENTURE, choice_log_open(&log, filename, &other));
+
+    unlink(filename);
+    free_adventure(&other);
+    free_adventure(&adv);
+}
+
+static void test_choice_log_compacts(void) {
+    char filename[64];
+    sprintf(filename, "/tmp/adv-test-log-%d", (int)getpid());
+    unlink(filename);
+
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    ChoiceLog log;
+
+    TEST_ASSERT_EQUAL(CHOICE_LOG_OK, choice_log_open(&log, filename, &adv));
+    choice_log_append(&log, 0, 0, 1, 0); // 0 is still playing, at 2
+    choice_log_append(&log, 1, 0, 2, 1);
+    choice_log_append(&log, 0, 1, 2, 0);
+    choice_log_append(&log, 1, 2, 3, 0); // 1 reached an ending
+    choice_log_append(&log, 2, 0, 1, 0);
+    choice_log_append(&log, 2, 0, 2, 1); // 2 started over
+    choice_log_append(&log, 3, 0, 3, 5); // no such option
+    choice_log_close(&log);
+
+    // it reports what it finds on stdout
+    fflush(stdout);
+    int const out = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    bool const ok = compact_choice_log(filename, &adv, true);
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    close(null);
+    TEST_ASSERT_TRUE(ok);
+
+    FILE *f = fopen(filename, "rb");
+    ChoiceLogHeader h;
+    ChoiceRecord records[8];
+    TEST_ASSERT_EQUAL(1, fread(&h, sizeof(h), 1, f));
+    TEST_ASSERT_EQUAL(3, fread(records, sizeof(ChoiceRecord), 8, f));
+    fclose(f);
+
+    TEST_ASSERT_EQUAL(adv.content_hash, h.content_hash);
+    TEST_ASSERT_EQUAL(0, records[0].session);
+    TEST_ASSERT_EQUAL(1, records[0].to);
+    TEST_ASSERT_EQUAL(0, records[1].session);
+    TEST_ASSERT_EQUAL(2, records[1].to);
+    TEST_ASSERT_EQUAL(2, records[2].session);
+    TEST_ASSERT_EQUAL(0, records[2].from);
+
+    // the ids of sessions compacted away aren't handed out again
+    TEST_ASSERT_EQUAL(CHOICE_LOG_OK, choice_log_open(&log, filename, &adv));
+    TEST_ASSERT_EQUAL(3, choice_log_session(&log));
+    choice_log_close(&log);
+
+    unlink(filename);
+    free_adventure(&adv);
+}
+
+// Simulation tests
+static void test_graph_follows_options(void) {
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    Graph g = adventure_graph(&adv);
+
+    TEST_ASSERT_EQUAL(adv.section_count, g.node_count);
+    for (uint32_t i = 0; i < g.node_count; ++i) {
+        Section *s = &adv.sections[i];
+        TEST_ASSERT_EQUAL(s->option_count, graph_degree(&g, i));
+
+        for (uint32_t j = 0; j < graph_degree(&g, i); ++j) {
+            TEST_ASSERT_EQUAL_PTR(find_section(&adv, section_options(s)[j].section_id), &adv.sections[g.targets[g.first[i] + j]]);
+        }
+    }
+
+    free_graph(&g);
+    free_adventure(&adv);
+}
+
+static void test_simulation_counts_every_run(void) {
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    Graph g = adventure_graph(&adv);
+    SimulateOptions const options = { .runs = 100000, .threads = 3, .seed = 7, .max_steps = 100 };
+
+    Simulation a = simulate(&g, options);
+    Simulation b = simulate(&g, options);
+
+    uint64_t ended = 0, lengths = 0;
+    for (uint32_t i = 0; i < g.node_count; ++i) {
+        ended += a.endings[i];
+        TEST_ASSERT_EQUAL(a.endings[i], b.endings[i]); // same seed, same runs
+        if (graph_degree(&g, i) > 0) TEST_ASSERT_EQUAL(0, a.endings[i]);
+    }
+    for (uint32_t l = 0; l <= options.max_steps; ++l) {
+        lengths += a.lengths[l];
+    }
+
+    TEST_ASSERT_EQUAL(options.runs, a.runs);
+    TEST_ASSERT_EQUAL(a.runs, ended + a.cut_off);
+    TEST_ASSERT_EQUAL(ended, lengths);
+    TEST_ASSERT_EQUAL(a.runs, a.visits[0]);
+
+    // two endings, one option away from a fair choice
+    TEST_ASSERT_UINT64_WITHIN(2000, options.runs / 2, a.endings[find_section(&adv, 3) - adv.sections]);
+
+    free_simulation(&a);
+    free_simulation(&b);
+    free_graph(&g);
+    free_adventure(&adv);
+}
+
+static void test_ending_odds(void) {
+    // 0 and 1 loop until 1 ends at 3, or 0 falls into the loop at 4
+    uint32_t first[] = {0, 2, 4, 5, 5, 6, 6};
+    uint32_t targets[] = {1, 2, 0, 3, 4, 4};
+    Graph g = (Graph){ .node_count = 6, .start = 0, .first = first, .targets = targets };
+
+    uint32_t component[6];
+    TEST_ASSERT_EQUAL(4, graph_components(&g, component));
+    TEST_ASSERT_EQUAL(3, component[0]); // the start's component comes last
+    TEST_ASSERT_EQUAL(component[0], component[1]);
+    TEST_ASSERT_TRUE(component[2] > component[4]);
+    TEST_ASSERT_EQUAL(NO_COMPONENT, component[5]);
+
+    EndingOdds odds = ending_odds(&g);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 1.0 / 3, odds.probability[3]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 2.0 / 3, odds.never);
+    TEST_ASSERT_EQUAL(2, odds.cyclic); // 4 loops on itself for ever
+    TEST_ASSERT_EQUAL(2, odds.largest);
+    free_ending_odds(&odds);
+
+    // a ring too big to solve densely, going both ways, every section can end at 300
+    uint32_t ring_first[302], ring_targets[900];
+    for (uint32_t i = 0; i < 300; ++i) {
+        ring_first[i] = 3 * i;
+        ring_targets[3 * i] = (i + 1) % 300;
+        ring_targets[3 * i + 1] = (i + 299) % 300;
+        ring_targets[3 * i + 2] = 300;
+    }
+    ring_first[300] = ring_first[301] = 900;
+    g = (Graph){ .node_count = 301, .start = 0, .first = ring_first, .targets = ring_targets };
+
+    odds = ending_odds(&g);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 1, odds.probability[300]);
+    TEST_ASSERT_EQUAL(300, odds.largest);
+    TEST_ASSERT_TRUE(odds.iterations > 0);
+    TEST_ASSERT_TRUE(odds.converged);
+    TEST_ASSERT_TRUE(odds.residual <= ENDINGS_TOLERANCE);
+    free_ending_odds(&odds);
+
+    // the fair choice between sections 3 and 4
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    g = adventure_graph(&adv);
+    odds = ending_odds(&g);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.5, odds.probability[find_section(&adv, 3) - adv.sections]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.5, odds.probability[find_section(&adv, 4) - adv.sections]);
+    free_ending_odds(&odds);
+    free_graph(&g);
+    free_adventure(&adv);
+}
+
+static void test_path_counts(void) {
+    // 70 diamonds in a row: 2^70 playthroughs, too many for 64 bits
+    uint32_t first[212], targets[280];
+    for (uint32_t d = 0; d < 70; ++d) {
+        uint32_t const top = 3 * d;
+        first[top] = 4 * d;
+        first[top + 1] = 4 * d + 2;
+        first[top + 2] = 4 * d + 3;
+        targets[4 * d] = top + 1;
+        targets[4 * d + 1] = top + 2;
+        targets[4 * d + 2] = top + 3;
+        targets[4 * d + 3] = top + 3;
+    }
+    first[210] = first[211] = 280;
+    Graph g = (Graph){ .node_count = 211, .start = 0, .first = first, .targets = targets };
+
+    PathCounts counts = count_paths(&g);
+    char *total = path_count_string(&counts.total);
+    TEST_ASSERT_EQUAL_STRING("1180591620717411303424", total);
+    TEST_ASSERT_FALSE(counts.total_endless);
+    free(total);
+    free_path_counts(&counts);
+
+    // 1 and 2 loop before ending 3, ending 4 can be reached straight away
+    uint32_t loop_first[] = {0, 2, 4, 5, 5, 5};
+    uint32_t loop_targets[] = {1, 4, 2, 3, 1};
+    g = (Graph){ .node_count = 5, .start = 0, .first = loop_first, .targets = loop_targets };
+
+    counts = count_paths(&g);
+    TEST_ASSERT_TRUE(counts.endless[3]);
+    TEST_ASSERT_FALSE(counts.endless[4]);
+    TEST_ASSERT_EQUAL(1, counts.endings[4].len);
+    TEST_ASSERT_EQUAL(1, counts.endings[4].limbs[0]);
+    TEST_ASSERT_TRUE(counts.total_endless);
+
+    // 1 and 2 are endless too, but they aren't endings
+    construct_file_like_obj(
+        "{\"title\": \"loop\", \"author\": \"me\", \"version\": \"1.0\", \"sections\": ["
+        "{\"id\": 0, \"text\": \"a\", \"options\": [{\"id\": 1, \"text\": \"1\"}, {\"id\": 4, \"text\": \"4\"}]},"
+        "{\"id\": 1, \"text\": \"b\", \"options\": [{\"id\": 2, \"text\": \"2\"}, {\"id\": 3, \"text\": \"3\"}]},"
+        "{\"id\": 2, \"text\": \"c\", \"options\": [{\"id\": 1, \"text\": \"1\"}]},"
+        "{\"id\": 3, \"text\": \"d\", \"options\": []},"
+        "{\"id\": 4, \"text\": \"e\", \"options\": []}]}"
+    );
+    Adventure adv = json_to_adventure(json_parse(stream));
+    TEST_ASSERT_NO_ERROR();
+
+    EndingCount endings[5];
+    TEST_ASSERT_EQUAL(2, ending_counts(&adv, &counts, endings));
+    TEST_ASSERT_EQUAL(3, endings[0].node);
+    TEST_ASSERT_TRUE(endings[0].endless);
+    TEST_ASSERT_EQUAL(4, endings[1].node);
+    TEST_ASSERT_FALSE(endings[1].endless);
+    free_adventure(&adv);
+    free_path_counts(&counts);
+
+    PathSampler sampler;
+    TEST_ASSERT_FALSE(path_sampler(&g, 1, &sampler));
+}
+
+static void test_path_walk_and_sample(void) {
+    Adventure adv = load_adventure("tests/test_file_bigger_adventure.json");
+    Graph g = adventure_graph(&adv);
+    uint32_t expected[][4] = {{0, 1, 2, 3}, {0, 1, 2, 4}, {0, 2, 3}, {0, 2, 4}};
+    uint32_t lengths[] = {4, 4, 3, 3};
+
+    PathWalk w = path_walk(&g, PATHS_DEFAULT_MAX_STEPS);
+    for (int i = 0; i < 4; ++i) {
+        TEST_ASSERT_TRUE(next_path(&w));
+        TEST_ASSERT_EQUAL(lengths[i], w.len);
+        for (uint32_t j = 0; j < w.len; ++j) {
+            TEST_ASSERT_EQUAL(expected[i][j], adv.sections[w.path[j]].id);
+        }
+    }
+    TEST_ASSERT_FALSE(next_path(&w));
+    TEST_ASSERT_FALSE(next_path(&w));
+    free_path_walk(&w);
+
+    // too short for the first two
+    w = path_walk(&g, 2);
+    TEST_ASSERT_TRUE(next_path(&w));
+    TEST_ASSERT_EQUAL(3, w.len);
+    free_path_walk(&w);
+
+    PathSampler sampler;
+    int picked[4] = {0};
+    TEST_ASSERT_TRUE(path_sampler(&g, 7, &sampler));
+    for (int i = 0; i < 4000; ++i) {
+        sample_path(&sampler);
+        uint32_t const second = adv.sections[sampler.path[1]].id;
+        uint32_t const last = adv.sections[sampler.path[sampler.len - 1]].id;
+        picked[(second == 2) * 2 + (last == 4)]++;
+    }
+    for (int i = 0; i < 4; ++i) {
+        TEST_ASSERT_INT_WITHIN(150, 1000, picked[i]);
+    }
+    free_path_sampler(&sampler);
+
+    free_graph(&g);
+    free_adventure(&adv);
+}
+
+static void test_compact_graph(void) {
+    // 0 -> 1 -> 2 then 3 or 4, both on to 5; 6 and 7 loop on their own
+    uint32_t first[] = {0, 1, 2, 4, 5, 6, 6, 7, 8};
+    uint32_t targets[] = {1, 2, 3, 4, 5, 5, 7, 6};
+    Graph g = (Graph){ .node_count = 8, .start = 0, .first = first, .targets = targets };
+
+    Graph c = compact_graph(&g);
+    TEST_ASSERT_EQUAL(8, c.original_count);
+    TEST_ASSERT_EQUAL(5, c.node_count);
+    TEST_ASSERT_EQUAL(c.node_of[0], c.start);
+    TEST_ASSERT_EQUAL(c.node_of[0], c.node_of[2]);
+    TEST_ASSERT_EQUAL(2, graph_steps(&c, c.start));
+    TEST_ASSERT_EQUAL(2, graph_last_segment(&c, c.start));
+    TEST_ASSERT_EQUAL(2, graph_degree(&c, c.start));
+    TEST_ASSERT_EQUAL(c.node_of[3], c.targets[c.first[c.start]]);
+    TEST_ASSERT_EQUAL(c.node_of[4], c.targets[c.first[c.start] + 1]);
+    TEST_ASSERT_NOT_EQUAL(c.node_of[3], c.node_of[5]);
+    TEST_ASSERT_EQUAL(c.node_of[6], c.node_of[7]);
+    TEST_ASSERT_EQUAL(c.node_of[6], c.targets[c.first[c.node_of[7]]]);
+
+    // nothing is chosen inside a chain, so nothing changes
+    EndingOdds odds = ending_odds(&c);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 1, odds.probability[c.node_of[5]]);
+    free_ending_odds(&odds);
+
+    PathCounts counts = count_paths(&c);
+    TEST_ASSERT_EQUAL(2, counts.total.limbs[0]);
+    free_path_counts(&counts);
+
+    SimulateOptions const options = { .runs = 1000, .threads = 1, .seed = 7, .max_steps = 100 };
+    Simulation s = simulate(&c, options);
+    TEST_ASSERT_EQUAL(options.runs, s.lengths[4]);
+    TEST_ASSERT_EQUAL(4 * options.runs, s.transitions);
+    free_simulation(&s);
+
+    free_graph(&c);
+}
+
+/*
+ * Connects to the server on socket_path, waiting for it to listen.
+ */
+static int connect_server(char *socket_path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strcpy(addr.sun_path, socket_path);
+    struct timeval const timeout = { .tv_sec = 2 };
+
+    for (int tries = 0; tries < 200; ++tries) {
+        int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            return fd;
+        }
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+/*
+ * Runs serve_adventure in a child process on a UNIX socket, keeping
+ * sessions in store unless it's NULL, and connects to it. Stop it
+ * with stop_server.
+ */
+static int start_server(pid_t *child, char *socket_path, char *filename, char *store) {
+    sprintf(socket_path, "/tmp/adv-test-sock-%d", (int)getpid());
+    unlink(socket_path);
+
+    *child = fork();
+    if (*child == 0) {
+        int const null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        ServeOptions options = (ServeOptions){
+            .socket = socket_path, .width = HEADLESS_WIDTH, .threads = 1, .store = store,
+        };
+        _exit(serve_adventure(filename, options) ? 0 : 1);
+    }
+
+    return connect_server(socket_path);
+}
+
+static void stop_server(pid_t child) {
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+}
+
+/*
+ * Reads what the server sends until it closes the connection or
+ * goes quiet, NUL terminated.
+ */
+static size_t read_until_closed(int fd, char *out, size_t size) {
+    size_t len = 0;
+    ssize_t n;
+
+    while (len < size - 1 && (n = read(fd, out + len, size - 1 - len)) > 0) {
+        len += n;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static void test_server_takes_keys_typed_ahead(void) {
+    char socket_path[64];
+    static char out[1 << 16];
+    pid_t child;
+
+    int const fd = start_server(&child, socket_path, "tests/test_file_bigger_adventure.json", NULL);
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    // three sections' worth of choices in a single write
+    TEST_ASSERT_EQUAL(3, write(fd, "111", 3));
+    read_until_closed(fd, out, sizeof(out));
+
+    TEST_ASSERT_NOT_NULL(strstr(out, "the story has to continue"));
+    TEST_ASSERT_NOT_NULL(strstr(out, "plott thickens."));
+    TEST_ASSERT_NOT_NULL(strstr(out, "The user changed the outcome"));
+
+    close(fd);
+    stop_server(child);
+}
+
+static void test_server_flushes_lone_escape(void) {
+    char socket_path[64];
+    static char out[1 << 16];
+    pid_t child;
+
+    int const fd = start_server(&child, socket_path, "tests/test_file_bigger_adventure.json", NULL);
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    // Esc on its own, then a choice: not Alt+1
+    TEST_ASSERT_EQUAL(1, write(fd, "\x1b", 1));
+    usleep(100000);
+    TEST_ASSERT_EQUAL(1, write(fd, "1", 1));
+    read_until_closed(fd, out, sizeof(out));
+
+    TEST_ASSERT_NOT_NULL(strstr(out, "the story has to continue"));
+
+    close(fd);
+    stop_server(child);
+}
+
+static void test_server_resume_needs_token(void) {
+    char socket_path[64], store[64], line[64];
+    static char out[1 << 16];
+    unsigned id, other;
+    unsigned long long token, other_token;
+    pid_t child;
+
+    sprintf(store, "/tmp/adv-test-serve-store-%d", (int)getpid());
+    unlink(store);
+    int fd = start_server(&child, socket_path, "tests/test_file_bigger_adventure.json", store);
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    struct timeval const quiet = { .tv_usec = 200000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &quiet, sizeof(quiet));
+    TEST_ASSERT_EQUAL(1, write(fd, "1", 1));
+    read_until_closed(fd, out, sizeof(out));
+    TEST_ASSERT_EQUAL(2, sscanf(out, "\x1b]0;adv session %u %llx", &id, &token));
+    close(fd);
+
+    // the session's number alone isn't enough
+    fd = connect_server(socket_path);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &quiet, sizeof(quiet));
+    sprintf(line, "resume %u %016llx\n", id, token ^ 1);
+    TEST_ASSERT_EQUAL(strlen(line), write(fd, line, strlen(line)));
+    read_until_closed(fd, out, sizeof(out));
+    TEST_ASSERT_EQUAL(2, sscanf(out, "\x1b]0;adv session %u %llx", &other, &other_token));
+    TEST_ASSERT_NOT_EQUAL(id, other); // a new session instead
+    TEST_ASSERT_NULL(strstr(out + 1, "\x1b]0;"));
+    close(fd);
+
+    fd = connect_server(socket_path);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &quiet, sizeof(quiet));
+    sprintf(line, "resume %u %016llx\n", id, token);
+    TEST_ASSERT_EQUAL(strlen(line), write(fd, line, strlen(line)));
+    read_until_closed(fd, out, sizeof(out));
+    sprintf(line, "\x1b]0;adv session %u %016llx\x07", id, token);
+    TEST_ASSERT_NOT_NULL(strstr(out, line));
+    TEST_ASSERT_NOT_NULL(strstr(out, "the story has to continue"));
+    close(fd);
+
+    stop_server(child);
+    unlink(store);
+}
+
 int main() {
     UnityBegin("tests/text_adventure_tests.c");
 
@@ -801,12 +2295,61 @@ int main() {
     RUN_TEST(test_convert_adventure_missing_title);
     RUN_TEST(test_convert_adventure_missing_author);
     RUN_TEST(test_convert_adventure_missing_version);
+    RUN_TEST(test_load_adventure_file_keeps_json_error);
     RUN_TEST(test_convert_adventure_missing_sections);
     RUN_TEST(test_convert_adventure_section_missing_id);
     RUN_TEST(test_convert_adventure_section_missing_text);
     RUN_TEST(test_convert_adventure_section_missing_options);
     RUN_TEST(test_convert_adventure_option_missing_id);
     RUN_TEST(test_convert_adventure_option_missing_text);
+    RUN_TEST(test_convert_adventure_with_many_options);
+    RUN_TEST(test_convert_adventure_too_many_options);
+    RUN_TEST(test_repeated_text_is_shared);
+    RUN_TEST(test_intern_string);
+    RUN_TEST(test_compressed_text_round_trip);
+    RUN_TEST(test_compressed_utf8_text);
+    RUN_TEST(test_frame_is_written_once);
+    RUN_TEST(test_frame_discard);
+    RUN_TEST(test_layout_wraps_full_words);
+    RUN_TEST(test_layout_breaks_on_newline);
+    RUN_TEST(test_layout_breaks_long_words);
+    RUN_TEST(test_char_width);
+    RUN_TEST(test_graphemes);
+    RUN_TEST(test_layout_wide_text);
+    RUN_TEST(test_layout_cache);
+    RUN_TEST(test_input_decodes_keys);
+    RUN_TEST(test_input_waits_for_partial_keys);
+    RUN_TEST(test_session_steps_through_sections);
+    RUN_TEST(test_sessions_render_independently);
+    RUN_TEST(test_server_takes_keys_typed_ahead);
+    RUN_TEST(test_server_flushes_lone_escape);
+    RUN_TEST(test_server_resume_needs_token);
+    RUN_TEST(test_save_restores_session);
+    RUN_TEST(test_save_forgets_old_history);
+    RUN_TEST(test_save_rejects_bad_saves);
+    RUN_TEST(test_store_keeps_sessions);
+    RUN_TEST(test_frame_cache_evicts_oldest);
+    RUN_TEST(test_session_renders_through_frame_cache);
+    RUN_TEST(test_choice_log_appends_records);
+    RUN_TEST(test_choice_log_compacts);
+    RUN_TEST(test_graph_follows_options);
+    RUN_TEST(test_simulation_counts_every_run);
+    RUN_TEST(test_ending_odds);
+    RUN_TEST(test_path_counts);
+    RUN_TEST(test_path_walk_and_sample);
+    RUN_TEST(test_compact_graph);
+    RUN_TEST(test_hint_distances);
+    RUN_TEST(test_hint_on_ending);
+    RUN_TEST(test_hint_without_reachable_ending);
+    RUN_TEST(test_reload_patches_edited_section);
+    RUN_TEST(test_reload_rejects_window_closing_early);
+    RUN_TEST(test_reload_outside_sections_parses_everything);
+    RUN_TEST(test_reload_frees_replaced_options);
+    RUN_TEST(test_reload_keeps_adventure_on_error);
+    RUN_TEST(test_catalog_round_trip);
+    RUN_TEST(test_catalog_knows_its_source);
+    RUN_TEST(test_catalog_dead_publisher);
+    RUN_TEST(test_catalog_missing_segment);
 
     return UnityEnd();
 }